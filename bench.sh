@@ -0,0 +1,67 @@
+#!/bin/sh
+# Times the stages of compile.sh and writes the results to a tab separated
+# file, one line per stage and input scale:
+#
+#   stage  scale  insns  runs  min_ms  median_ms
+#
+# The synthetic inputs have 10x and 100x the number of insns.  For s-exprpp
+# the preprocessed input is repeated, the stages inside the generator build
+# the insn blocks several times (see 'sh_insns --bench').  The compile stage
+# is only timed for the real input.
+#
+# usage: ./bench.sh [results_file]    (RUNS=n sets the number of runs)
+
+set -e
+
+RUNS=${RUNS:-5}
+RESULTS=${1:-bench-results.tsv}
+SCALES="1 10 100"
+TMP=bench.tmp
+
+# Runs the command in $2 $RUNS times and prints the result line for stage $1
+# with scale $3.
+time_stage ()
+{
+  i=0
+  while [ $i -lt $RUNS ]; do
+    start=$(date +%s%N)
+    sh -c "$2" > /dev/null
+    end=$(date +%s%N)
+    echo $(( (end - start) / 1000 ))
+    i=$((i + 1))
+  done | sort -n | awk -v stage="$1" -v scale="$3" -v runs="$RUNS" '
+    { t[NR] = $1 / 1000 }
+    END {
+      m = NR % 2 ? t[(NR + 1) / 2] : (t[NR / 2] + t[NR / 2 + 1]) / 2
+      printf "%s\t%d\t-\t%d\t%.3f\t%.3f\n", stage, scale, runs, t[1], m
+    }'
+}
+
+mkdir -p $TMP
+c++ -std=c++11 -D__gen__ -E sh_insns.cpp > $TMP/sh_insns.i
+
+echo "stage	scale	insns	runs	min_ms	median_ms" > "$RESULTS"
+
+echo "s-exprpp..."
+for s in $SCALES; do
+  : > $TMP/input.i
+  i=0
+  while [ $i -lt $s ]; do
+    cat $TMP/sh_insns.i >> $TMP/input.i
+    i=$((i + 1))
+  done
+  time_stage s-exprpp "./s-exprpp < $TMP/input.i" $s >> "$RESULTS"
+done
+
+echo "compiling..."
+./s-exprpp < $TMP/sh_insns.i > $TMP/sh_insns.ii
+time_stage compile \
+  "c++ -std=c++11 -D__gen__ -O2 $TMP/sh_insns.ii -o $TMP/sh_insns" 1 >> "$RESULTS"
+
+echo "generating..."
+for s in $SCALES; do
+  $TMP/sh_insns --bench $RUNS --bench-scale $s >> "$RESULTS"
+done
+
+rm -rf $TMP
+cat "$RESULTS"
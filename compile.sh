@@ -1,5 +1,9 @@
 #!/bin/sh
 # g++-4.7 -std=c++11 -O2 s-exprpp.cpp -o s-exprpp
+# g++-4.7 -std=c++11 -O2 svgmin.cpp -o svgmin
+# g++-4.7 -std=c++11 -O2 -c shdb.cpp && ar rcs libshdb.a shdb.o
+# g++-4.7 -std=c++11 -O2 -c shtrace.cpp && ar rcs libshtrace.a shtrace.o  (link with -lz -pthread)
+# g++-4.7 -std=c++11 -O2 -pthread shtiming.cpp shdb.cpp shtrace.cpp -lz -o shtiming
 
 #g++-4.7 -std=c++11 -D__gen__ -E sh_insns.cpp | ./s-exprpp > sh_insns.ii
 #g++-4.7 -std=c++11 -D__gen__ -O2 sh_insns.ii -lboost_system -o sh_insns
@@ -13,8 +17,15 @@ c++ -std=c++11 -D__gen__ -E sh_insns.cpp | ./s-exprpp > sh_insns.ii
 echo "compiling..."
 c++ -std=c++11 -D__gen__ -O2 sh_insns.ii -o sh_insns
 
+echo "optimizing svg..."
+mkdir -p html
+for f in *.svg; do
+  ./svgmin -n "${f%.svg}-" < "$f" > "html/$f"
+done
+
 echo "executing..."
-./sh_insns > sh_insns.html
+# Use './sh_insns --inline-svg html' to embed the diagrams into the page.
+./sh_insns > html/sh_insns.html
 
 echo "done"
 
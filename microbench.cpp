@@ -0,0 +1,93 @@
+/*
+microbench - Runs the micro-benchmarks written by 'sh_insns --microbench'.
+
+This is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this software; see the file LICENSE.  If not see
+<http://www.gnu.org/licenses/>.
+
+*/
+
+// This runs on the target and is linked with the generated microbench.S:
+//
+//   sh4-linux-gnu-g++ -m4 -O2 microbench.cpp microbench.S -o microbench
+//   ./microbench 200 > results.tsv
+//
+// The CPU clock in MHz converts the times into cycles.  For each benchmark
+// the cycles per insn (per pair of insns for the pair benchmarks) are
+// printed as tab separated lines:
+//
+//   id  cycles
+//
+// The time of the empty loop is subtracted from all benchmarks.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+
+struct microbench
+{
+  const char* id;
+  void (*run) (unsigned int iterations);
+  unsigned int ops;
+};
+
+extern "C" const microbench microbench_table[];
+
+// Returns the fastest of a few runs in ns.
+double run_ns (const microbench& b, unsigned int iterations)
+{
+  double best = 0;
+
+  for (int r = 0; r < 5; ++r)
+  {
+    auto start = std::chrono::steady_clock::now ();
+    b.run (iterations);
+    auto end = std::chrono::steady_clock::now ();
+
+    double t = std::chrono::duration<double, std::nano> (end - start).count ();
+    if (r == 0 || t < best)
+      best = t;
+  }
+  return best;
+}
+
+int main (int argc, char* argv[])
+{
+  const double mhz = argc > 1 ? std::atof (argv[1]) : 0;
+  const unsigned int iterations = argc > 2 ? std::atoi (argv[2]) : 100000;
+
+  if (mhz <= 0 || iterations == 0)
+  {
+    std::fprintf (stderr, "usage: %s mhz [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  double loop_ns = 0;
+  for (const microbench* b = microbench_table; b->id != nullptr; ++b)
+    if (std::strcmp (b->id, "loop") == 0)
+      loop_ns = run_ns (*b, iterations);
+
+  std::printf ("id\tcycles\n");
+
+  for (const microbench* b = microbench_table; b->id != nullptr; ++b)
+  {
+    if (std::strcmp (b->id, "loop") == 0)
+      continue;
+
+    const double ns = run_ns (*b, iterations) - loop_ns;
+    std::printf ("%s\t%.2f\n", b->id, ns * mhz / 1000 / iterations / b->ops);
+  }
+
+  return 0;
+}
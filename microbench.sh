@@ -0,0 +1,84 @@
+#!/bin/sh
+# Builds and runs the micro-benchmarks for one ISA and compares the measured
+# cycles with the issue / latency cycles in the table.
+#
+# usage: ./microbench.sh isa mhz        e.g. ./microbench.sh SH4 200
+#
+#   CXX      the cross compiler, default sh4-linux-gnu-g++
+#   RUN      command prefix that runs the benchmark on the board, e.g. a
+#            script that copies the binary over and runs it there
+#   RESULTS  compare this results file of an earlier run instead of running
+#            the benchmarks
+#
+# All benchmarks are listed with the claimed and measured cycles.  A measured
+# value that is more than 0.25 cycles away from the claimed ones is marked
+# with '!'.  Claims like "3/4" or "1-3" match any of / all values between
+# the numbers.
+
+set -e
+
+ISA=$1
+MHZ=$2
+CXX=${CXX:-sh4-linux-gnu-g++}
+DIR=microbench.$ISA
+
+if [ -z "$ISA" ] || [ -z "$MHZ" ]; then
+  echo "usage: $0 isa mhz"
+  exit 1
+fi
+
+case $ISA in
+  SH1) FLAGS=-m1 ;;
+  SH2) FLAGS=-m2 ;;
+  SH2E) FLAGS=-m2e ;;
+  SH2A) FLAGS=-m2a ;;
+  SH3) FLAGS=-m3 ;;
+  SH3E) FLAGS=-m3e ;;
+  SH4) FLAGS=-m4 ;;
+  SH4A) FLAGS=-m4a ;;
+  DSP) FLAGS="-m2 -Wa,-dsp" ;;
+  *) echo "unknown isa $ISA"; exit 1 ;;
+esac
+
+mkdir -p $DIR
+./sh_insns --microbench $DIR --microbench-isa $ISA > /dev/null
+
+if [ -z "$RESULTS" ]; then
+  $CXX $FLAGS -std=c++11 -O2 microbench.cpp $DIR/microbench.S -o $DIR/microbench
+  $RUN $DIR/microbench $MHZ > $DIR/results.tsv
+  RESULTS=$DIR/results.tsv
+fi
+
+awk -F '\t' '
+  FNR == 1 { next }
+  NR == FNR { measured[$1] = $2; next }
+
+  function matches(claimed, m,    n, v, i, r)
+  {
+    n = split (claimed, v, "/")
+    for (i = 1; i <= n; ++i)
+    {
+      if (split (v[i], r, "-") == 2)
+      {
+	if (m >= r[1] - 0.25 && m <= r[2] + 0.25)
+	  return 1
+      }
+      else if (v[i] ~ /^[0-9]+$/ && m >= v[i] - 0.25 && m <= v[i] + 0.25)
+	return 1
+    }
+    return 0
+  }
+
+  {
+    if (!($1 in measured))
+      next
+    m = measured[$1]
+    mark = matches($4, m) ? " " : "!"
+    if (mark == "!")
+      mismatches++
+    printf "%s %-16s %-10s %-44s %8s %8.2f\n", mark, $1, $2, $3, $4, m
+    count++
+  }
+
+  END { printf "\n%d benchmarks, %d differ from the table\n", count, mismatches }
+' "$RESULTS" $DIR/expected.tsv
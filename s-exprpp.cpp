@@ -25,6 +25,7 @@ along with this software; see the file LICENSE.  If not see
 #include <algorithm>
 #include <exception>
 #include <cassert>
+#include <limits>
 
 std::istream& skip_spaces (std::istream& in)
 {
@@ -257,7 +258,7 @@ int main (void)
 }
 
 
-#endif
+
 
 /*
 static const std::vector<std::string> test_inputs
@@ -20,20 +20,55 @@ along with this software; see the file LICENSE.  If not see
 */
 
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <string>
 #include <cstring>
+#include <cstdlib>
 #include <vector>
 #include <map>
+#include <set>
 #include <array>
 #include <cctype>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <type_traits>
+#include <functional>
+#include <chrono>
+
+#include "shdb_format.h"
 
 // ----------------------------------------------------------------------------
 
+// A string literal of the tables with its length, which is taken when the
+// tables are built, so that printing the page doesn't need strlen.
+struct text
+{
+  constexpr text (void) : str (""), size (0) { }
+
+  template <size_t N> constexpr text (const char (&s)[N]) : str (s), size (N - 1) { }
+
+  constexpr text (const char* s, size_t n) : str (s), size (n) { }
+
+  template <typename T> text (T s,
+			      typename std::enable_if<std::is_same<T, const char*>::value>::type* = nullptr)
+  : str (s), size (std::strlen (s))
+  {
+  }
+
+  operator const char* (void) const { return str; }
+  operator std::string (void) const { return std::string (str, size); }
+
+  const char* str;
+  size_t size;
+};
+
 #define make_property_class(name)\
   struct name \
   {\
-    inline name (const char* val) : value (val) { } \
-    const char* value; \
+    inline name (const text& val) : value (val) { } \
+    text value; \
   };
 
 make_property_class (format)
@@ -46,312 +81,1994 @@ make_property_class (example)
 make_property_class (exceptions)
 
 
-enum isa
+enum isa
+{
+  SH_NONE = 0,
+
+  SH1,
+  SH2,
+  SH2E,
+  SH2A,
+  SH3,
+  SH3E,
+  SH4,
+  SH4A,
+
+  SH_DSP,
+
+  __isa_max__,
+};
+
+const struct any_isa { } SH_ANY;
+
+struct isa_property
+{
+  isa_property (void) { }
+
+  void operator () (void) { }
+
+  template <typename... Args> void
+  operator () (isa f, const text& val, Args&&... args)
+  {
+    values[(int)f] = val;
+    (*this) (std::forward<Args> (args)...);
+  }
+
+  template <typename... Args> void
+  operator () (any_isa, const text& val, Args&&... args)
+  {
+    for (auto& v : values)
+      v = val;
+    (*this) (std::forward<Args> (args)...);
+  }
+
+  template <typename... Args> isa_property (const Args&... args)
+  {
+    (*this) (args...);
+  }
+
+  const text& operator[] (isa i) const { return values[(int)i]; }
+
+  std::array<text, __isa_max__> values;
+};
+
+struct group : public isa_property
+{
+  template <typename... Args> group (Args&&... args)
+  : isa_property (std::forward<Args> (args)...)
+  {
+  }
+};
+
+struct issue : public isa_property
+{
+  template <typename... Args> issue (Args&&... args)
+  : isa_property (std::forward<Args> (args)...)
+  {
+  }
+};
+
+struct latency : public isa_property
+{
+  template <typename... Args> latency (Args&&... args)
+  : isa_property (std::forward<Args> (args)...)
+  {
+  }
+};
+
+isa_property isa_name = isa_property
+(
+  SH1, "SH1",
+  SH2, "SH2",
+  SH2E, "SH2E",
+  SH2A, "SH2A",
+  SH3, "SH3",
+  SH3E, "SH3E",
+  SH4, "SH4",
+  SH4A, "SH4A",
+  SH_DSP, "DSP"
+);
+
+const struct privileged_tag { } privileged;
+
+struct t_bit
+{
+  t_bit (void) { }
+
+  t_bit (const text& note)
+  : note_ (note)
+  {
+  }
+
+  text note_;
+};
+
+struct dc_bit
+{
+  dc_bit (void) { }
+  dc_bit (const text& note)
+  : note_ (note)
+  {
+  }
+  text note_;
+};
+
+struct insn
+{
+  void operator () (void) { }
+  void operator () (const format& p) { format_ = p.value; }
+  void operator () (const abstract& p) { abstract_ = p.value; }
+  void operator () (const code& p) { code_ = p.value; }
+  void operator () (const description& p) { description_ = p.value; }
+  void operator () (const note& p) { note_ = p.value; }
+  void operator () (const operation& p) { operation_ = p.value; }
+  void operator () (const example& p) { example_ = p.value; }
+  void operator () (const exceptions& p) { exceptions_ = p.value; }
+  void operator () (isa i) { isa_ |= (1 << (int)i); }
+  void operator () (any_isa) { isa_ = -1 & ~((1 << (int)SH_DSP) | (1 << (int)SH2E) | (1 << (int)SH3E)); }
+  void operator () (const group& g) { group_ = g; }
+  void operator () (const issue& i) { issue_ = i; }
+  void operator () (const latency& l) { latency_ = l; }
+  void operator () (privileged_tag) { privileged_ = true; }
+  void operator () (const t_bit& t) { t_bit_ = t; }
+  void operator () (const dc_bit& dc) { dc_bit_ = dc; }
+
+  template <typename T> void operator () (const T&);
+
+  template <typename T, typename... Args> void
+  operator () (const T& a, const Args&... args)
+  {
+    (*this) (a);
+    (*this) (args...);
+  }
+
+  template <typename... Args> insn (const text& format, const Args&... args)
+  : format_ (format)
+  {
+    (*this) (args...);
+  }
+
+  bool is_isa (isa i) const { return (isa_ & (1 << (int)i)) != 0; }
+
+  int isa_ = 0;
+  bool privileged_ = false;
+
+  t_bit t_bit_;
+  dc_bit dc_bit_;
+
+  text format_;
+  text abstract_;
+  text code_;
+
+  group group_;
+  issue issue_;
+  latency latency_;
+
+  text description_;
+  text note_;
+  text operation_;
+  text example_;
+  text exceptions_;
+};
+
+struct insns : public std::vector<insn>
+{
+  void operator () (void) { }
+  void operator () (const insn& i) { push_back (i); }
+
+  template <typename T> void operator () (const T&);
+
+  template <typename T, typename... Args> void
+  operator () (const T& a, const Args&... args)
+  {
+    (*this) (a);
+    (*this) (args...);
+  }
+
+  template <typename... Args> insns (const text& title, const Args&... args)
+  : title_ (title)
+  {
+    reserve (sizeof... (args));
+    (*this) (args...);
+  }
+
+  text title_;
+};
+
+const insn dummy_insn ("", SH1, SH2, SH2E, SH2A, SH3, SH3E, SH4, SH4A, SH_DSP);
+
+// ----------------------------------------------------------------------------
+
+std::vector<insns> insn_blocks;
+
+void build_insn_blocks (void);
+
+// ----------------------------------------------------------------------------
+// The whole page is collected in one buffer and written out at once.
+
+struct out_buffer
+{
+  // string literals are appended with their compile-time length.
+  template <size_t N> out_buffer& operator << (const char (&s)[N])
+  {
+    data.append (s, N - 1);
+    return *this;
+  }
+
+  template <typename T> typename std::enable_if<std::is_same<T, const char*>::value,
+						out_buffer&>::type
+  operator << (T s)
+  {
+    data.append (s);
+    return *this;
+  }
+
+  out_buffer& operator << (const text& s)
+  {
+    data.append (s.str, s.size);
+    return *this;
+  }
+
+  out_buffer& operator << (const std::string& s)
+  {
+    data.append (s);
+    return *this;
+  }
+
+  out_buffer& operator << (char c)
+  {
+    data.push_back (c);
+    return *this;
+  }
+
+  void write (std::ostream& o) const
+  {
+    o.write (data.data (), data.size ());
+    o.flush ();
+  }
+
+  std::string data;
+};
+
+out_buffer out;
+
+// ----------------------------------------------------------------------------
+
+enum note_type
+{
+  note_normal,
+  note_code
+};
+
+// If not empty, the <img src="*.svg"/> diagrams in the notes are replaced
+// with the SVG markup of the same file in this directory.  The minimized
+// diagrams are small enough to be part of the page and opening a note won't
+// trigger another request.  Each diagram is stored once as a <symbol> in a
+// sprite sheet after the insn blocks and the notes refer to it with <use>,
+// so diagrams shown in several notes don't duplicate the markup and its ids.
+std::string inline_svg_dir;
+
+// The <symbol> elements of the diagrams used so far, by file name.
+std::map<std::string, std::string> inline_svg_symbols;
+
+// The page is XHTML, so every <svg> element declares the SVG namespace and
+// the xlink prefix used by <use>.
+const char svg_namespaces[] =
+  "xmlns=\"http://www.w3.org/2000/svg\" "
+  "xmlns:xlink=\"http://www.w3.org/1999/xlink\"";
+
+// Returns the SVG markup that shows the diagram referenced by the <img> tag
+// 'img', or an empty string if the file can't be read.  The height of the
+// <img> tag is applied to the SVG element.
+std::string inline_svg (const std::string& img)
+{
+  auto attr_value = [] (const std::string& tag, const char* name)
+  {
+    std::string n = std::string (" ") + name + "=\"";
+    size_t p = tag.find (n);
+    if (p == std::string::npos)
+      return std::string ();
+    p += n.size ();
+    return tag.substr (p, tag.find ('"', p) - p);
+  };
+
+  const std::string src = attr_value (img, "src");
+  const std::string id = "svg-" + src.substr (0, src.rfind ('.'));
+
+  auto sym = inline_svg_symbols.find (src);
+  if (sym == inline_svg_symbols.end ())
+  {
+    std::ifstream f (inline_svg_dir + "/" + src);
+    if (!f.good ())
+      return std::string ();
+
+    std::stringstream buf;
+    buf << f.rdbuf ();
+    std::string svg = buf.str ();
+
+    size_t root = svg.find ("<svg ");
+    size_t end = svg.rfind ("</svg>");
+    if (root == std::string::npos || end == std::string::npos || end < root)
+      return std::string ();
+    svg.erase (end);
+    svg.erase (0, root);
+
+    // Drop the size of the diagram and let the viewBox scale it.  The
+    // namespace is declared by the sprite sheet.
+    size_t root_end = svg.find ('>');
+    for (const char* a : { "width", "height", "xmlns" })
+    {
+      std::string v = attr_value (svg.substr (0, root_end), a);
+      if (!v.empty ())
+      {
+	std::string at = std::string (" ") + a + "=\"" + v + "\"";
+	svg.erase (svg.find (at), at.size ());
+	root_end -= at.size ();
+      }
+    }
+
+    svg.replace (0, 4, "<symbol id=\"" + id + "\"");
+    sym = inline_svg_symbols.insert (std::make_pair (src, svg + "</symbol>")).first;
+  }
+
+  const std::string symbol_tag = sym->second.substr (0, sym->second.find ('>'));
+  std::string r = std::string ("<svg ") + svg_namespaces;
+  std::string h = attr_value (img, "height");
+  if (!h.empty ())
+    r += " height=\"" + h + "\"";
+  std::string vb = attr_value (symbol_tag, "viewBox");
+  if (!vb.empty ())
+    r += " viewBox=\"" + vb + "\"";
+
+  return r + "><use xlink:href=\"#" + id + "\"/></svg>";
+}
+
+// The sprite sheet with the diagrams of all notes.  It is not displayed
+// with display:none, which would disable the clip paths in the symbols.
+void print_inline_svg_symbols (void)
+{
+  if (inline_svg_symbols.empty ())
+    return;
+
+  out << "<svg " << svg_namespaces
+      << " style=\"position:absolute;width:0;height:0;overflow:hidden\""
+	 " aria-hidden=\"true\">\n";
+  for (const auto& s : inline_svg_symbols)
+    out << s.second << "\n";
+  out << "</svg>\n";
+}
+
+// Prints the note 'val' with the <img> diagrams replaced by their SVG
+// markup.
+void print_inline_svg_images (const text& val)
+{
+  if (std::strstr (val, "<img ") == nullptr)
+  {
+    out << val;
+    return;
+  }
+
+  std::string r = val;
+
+  for (size_t p = r.find ("<img "); p != std::string::npos;
+       p = r.find ("<img ", p + 1))
+  {
+    size_t end = r.find ("/>", p);
+    if (end == std::string::npos)
+      break;
+    end += 2;
+
+    std::string svg = inline_svg (r.substr (p, end - p));
+    if (!svg.empty ())
+      r.replace (p, end - p, svg);
+  }
+
+  out << r;
+}
+
+void print_note (const char* name, const text& note, note_type t)
+{
+  // skip leading line breaks in the input string.
+  size_t skip = 0;
+  while (skip < note.size && note.str[skip] == '\n')
+    skip++;
+
+  const text val (note.str + skip, note.size - skip);
+  if (val.size == 0)
+    return;
+
+  out << "<i><b>" << name << "</i></b><br/>";
+  if (t == note_normal && !inline_svg_dir.empty ())
+  {
+    print_inline_svg_images (val);
+    out << "<br/><br/>";
+  }
+  else if (t == note_normal)
+    out << val << "<br/><br/>";
+  else if (t == note_code)
+  {
+    out << "<pre><p class=\"precode\">"
+	<< val
+	<< "</p></pre>";
+  }
+
+  out << "\n\n";
+}
+
+void print_isa_prop (const text& p)
+{
+  out.data.append (p.str, p.size);
+  if (p.size < 6)
+    out.data.append (6 - p.size, ' ');
+}
+
+void print_isa_props (const insn& i, const isa_property& p)
+{
+  // this one defines the order of the ISA matrices.
+  print_isa_prop (i.is_isa (SH1) ? p.values[SH1] : text ());
+  print_isa_prop (i.is_isa (SH2) ? p.values[SH2] : text ());
+  print_isa_prop (i.is_isa (SH2E) ? p.values[SH2E] : text ());
+  out << '\n';
+  print_isa_prop (i.is_isa (SH3) ? p.values[SH3] : text ());
+  print_isa_prop (i.is_isa (SH3E) ? p.values[SH3E] : text ());
+  print_isa_prop (i.is_isa (SH_DSP) ? p.values[SH_DSP] : text ());
+  out << '\n';
+  print_isa_prop (i.is_isa (SH4) ? p.values[SH4] : text ());
+  print_isa_prop (i.is_isa (SH4A) ? p.values[SH4A] : text ());
+  print_isa_prop (i.is_isa (SH2A) ? p.values[SH2A] : text ());
+}
+
+void print_isa_compatibility (const insn& i)
+{
+  print_isa_props (i, isa_name);
+
+  if (i.privileged_)
+    out << "\nPrivileged";
+}
+
+void print_t_bit_dc_bit_note (const insn& i)
+{
+  out << i.t_bit_.note_ << '\n' << i.dc_bit_.note_;
+}
+
+// ----------------------------------------------------------------------------
+// Machine readable exports of the insn_blocks.
+
+// The fixed bits of an insn code string such as "0110nnnnmmmm0011".  Every
+// character other than '0' and '1' is a variable bit.  The '*' bits of the
+// DSP codes are not used by the insn itself.
+struct code_pattern
+{
+  code_pattern (const char* c)
+  {
+    for (; *c != '\0'; ++c)
+    {
+      if (std::isspace (*c))
+	continue;
+
+      match <<= 1;
+      mask <<= 1;
+      used = (used << 1) | (*c != '*');
+      size++;
+
+      if (*c == '0' || *c == '1')
+      {
+	match |= *c - '0';
+	mask |= 1;
+      }
+    }
+  }
+
+  unsigned int size = 0;
+  uint32_t match = 0;
+  uint32_t mask = 0;
+  uint32_t used = 0;
+};
+
+// The FPSCR.SZ / FPSCR.PR mode that selects the insns of a block.  -1 means
+// that the insns don't depend on the mode.
+struct fpscr_mode
+{
+  fpscr_mode (const char* block_title)
+  {
+    if (const char* p = std::strstr (block_title, "FPSCR.SZ = "))
+      sz = p[11] - '0';
+    if (const char* p = std::strstr (block_title, "FPSCR.PR = "))
+      pr = p[11] - '0';
+  }
+
+  bool compatible (const fpscr_mode& m) const
+  {
+    return (sz < 0 || m.sz < 0 || sz == m.sz)
+	   && (pr < 0 || m.pr < 0 || pr == m.pr);
+  }
+
+  int sz = -1;
+  int pr = -1;
+};
+
+// The notes are raw strings that start and end with line breaks.
+std::string trimmed (const char* s)
+{
+  while (*s != '\0' && std::isspace (*s))
+    s++;
+
+  std::string r = s;
+  while (!r.empty () && std::isspace (r.back ()))
+    r.pop_back ();
+  return r;
+}
+
+void print_json_str (out_buffer& o, const std::string& s)
+{
+  o << '"';
+  for (char c : s)
+  {
+    switch (c)
+    {
+      case '"': o << "\\\""; break;
+      case '\\': o << "\\\\"; break;
+      case '\n': o << "\\n"; break;
+      case '\t': o << "\\t"; break;
+      case '\r': o << "\\r"; break;
+      default:
+	if ((unsigned char)c < 0x20)
+	{
+	  char buf[8];
+	  std::snprintf (buf, sizeof (buf), "\\u%04x", c);
+	  o << std::string (buf);
+	}
+	else
+	  o << c;
+    }
+  }
+  o << '"';
+}
+
+void print_json_isa_props (out_buffer& o, const insn& i, const isa_property& p)
+{
+  o << '{';
+  bool first = true;
+  for (int a = SH1; a < __isa_max__; ++a)
+    if (i.is_isa ((isa)a) && *p.values[a] != '\0')
+    {
+      o << (first ? "" : ", ");
+      print_json_str (o, isa_name.values[a]);
+      o << ": ";
+      print_json_str (o, p.values[a]);
+      first = false;
+    }
+  o << '}';
+}
+
+void export_json (std::ostream& f)
+{
+  out_buffer o;
+
+  o << "{\n\"blocks\": [";
+  for (const auto& b : insn_blocks)
+  {
+    o << (&b == &insn_blocks.front () ? "\n" : ",\n") << "{\n\"title\": ";
+    print_json_str (o, b.title_);
+    o << ",\n\"insns\": [";
+
+    for (const auto& i : b)
+    {
+      o << (&i == &b.front () ? "\n" : ",\n") << "{\"format\": ";
+      print_json_str (o, i.format_);
+      o << ", \"abstract\": ";
+      print_json_str (o, i.abstract_);
+      o << ", \"code\": ";
+      print_json_str (o, i.code_);
+
+      o << ", \"isa\": [";
+      bool first = true;
+      for (int a = SH1; a < __isa_max__; ++a)
+	if (i.is_isa ((isa)a))
+	{
+	  o << (first ? "" : ", ");
+	  print_json_str (o, isa_name.values[a]);
+	  first = false;
+	}
+
+      o << "], \"privileged\": " << (i.privileged_ ? "true" : "false");
+      o << ", \"t_bit\": ";
+      print_json_str (o, i.t_bit_.note_);
+      o << ", \"dc_bit\": ";
+      print_json_str (o, i.dc_bit_.note_);
+      o << ", \"group\": ";
+      print_json_isa_props (o, i, i.group_);
+      o << ", \"issue\": ";
+      print_json_isa_props (o, i, i.issue_);
+      o << ", \"latency\": ";
+      print_json_isa_props (o, i, i.latency_);
+      o << ", \"description\": ";
+      print_json_str (o, trimmed (i.description_));
+      o << ", \"note\": ";
+      print_json_str (o, trimmed (i.note_));
+      o << ", \"operation\": ";
+      print_json_str (o, trimmed (i.operation_));
+      o << ", \"example\": ";
+      print_json_str (o, trimmed (i.example_));
+      o << ", \"exceptions\": ";
+      print_json_str (o, trimmed (i.exceptions_));
+      o << '}';
+    }
+    o << "\n]\n}";
+  }
+  o << "\n]\n}\n";
+
+  o.write (f);
+}
+
+void print_csv_field (out_buffer& o, const char* s)
+{
+  if (std::strpbrk (s, ",\"\n\r") == nullptr)
+  {
+    o << s;
+    return;
+  }
+
+  o << '"';
+  for (; *s != '\0'; ++s)
+  {
+    if (*s == '"')
+      o << '"';
+    o << *s;
+  }
+  o << '"';
+}
+
+// One row per insn and isa.
+void export_csv (std::ostream& f)
+{
+  out_buffer o;
+
+  o << "block,format,abstract,code,isa,privileged,group,issue,latency\r\n";
+  for (const auto& b : insn_blocks)
+    for (const auto& i : b)
+      for (int a = SH1; a < __isa_max__; ++a)
+      {
+	if (!i.is_isa ((isa)a))
+	  continue;
+
+	print_csv_field (o, b.title_);
+	o << ',';
+	print_csv_field (o, i.format_);
+	o << ',';
+	print_csv_field (o, i.abstract_);
+	o << ',';
+	print_csv_field (o, i.code_);
+	o << ',' << isa_name.values[a] << ',' << (i.privileged_ ? "1" : "0")
+	  << ',';
+	print_csv_field (o, i.group_.values[a]);
+	o << ',';
+	print_csv_field (o, i.issue_.values[a]);
+	o << ',';
+	print_csv_field (o, i.latency_.values[a]);
+	o << "\r\n";
+      }
+
+  o.write (f);
+}
+
+// The string pool of the binary database.  Equal strings are stored once.
+struct db_strings
+{
+  db_strings (void) : pool (1, '\0') { }
+
+  uint32_t operator () (const std::string& s)
+  {
+    if (s.empty ())
+      return 0;
+
+    auto i = offsets.find (s);
+    if (i != offsets.end ())
+      return i->second;
+
+    uint32_t r = pool.size ();
+    pool.append (s.c_str (), s.size () + 1);
+    offsets[s] = r;
+    return r;
+  }
+
+  std::string pool;
+  std::map<std::string, uint32_t> offsets;
+};
+
+// Flattens a list of insn number lists into a table of 'lists.size () + 1'
+// start positions followed by the insn numbers.
+std::vector<uint32_t> db_bucket_index (const std::vector<std::vector<uint32_t>>& lists)
+{
+  std::vector<uint32_t> r;
+  uint32_t pos = 0;
+  for (const auto& l : lists)
+  {
+    r.push_back (pos);
+    pos += l.size ();
+  }
+  r.push_back (pos);
+
+  for (const auto& l : lists)
+    r.insert (r.end (), l.begin (), l.end ());
+
+  return r;
+}
+
+// The mnemonic is the first word of the format.
+std::string mnemonic (const char* format)
+{
+  const char* end = format;
+  while (*end != '\0' && !std::isspace (*end))
+    end++;
+  return std::string (format, end);
+}
+
+// See shdb_format.h for the file layout.
+void export_db (std::ostream& f)
+{
+  static_assert ((int)shdb::db_isa_count == (int)__isa_max__,
+		 "db_isa_count doesn't match the isa enum");
+
+  db_strings str;
+
+  std::array<uint32_t, __isa_max__> isa_names;
+  for (int a = 0; a < __isa_max__; ++a)
+    isa_names[a] = str (isa_name.values[a]);
+
+  std::vector<shdb::db_block> blocks;
+  std::vector<shdb::db_insn> insns;
+
+  for (const auto& b : insn_blocks)
+  {
+    shdb::db_block bb;
+    bb.title = str (b.title_);
+    bb.first_insn = insns.size ();
+    bb.insn_count = b.size ();
+
+    for (const auto& i : b)
+    {
+      shdb::db_insn ii;
+      std::memset (&ii, 0, sizeof (ii));
+
+      code_pattern c (i.code_);
+
+      fpscr_mode m (b.title_);
+
+      ii.block = blocks.size ();
+      ii.isa_mask = i.isa_ & ((1 << __isa_max__) - 1) & ~(1 << SH_NONE);
+      ii.flags = (i.privileged_ ? shdb::db_insn_privileged : 0)
+		 | (m.sz == 0 ? shdb::db_insn_fpscr_sz0 : 0)
+		 | (m.sz == 1 ? shdb::db_insn_fpscr_sz1 : 0)
+		 | (m.pr == 0 ? shdb::db_insn_fpscr_pr0 : 0)
+		 | (m.pr == 1 ? shdb::db_insn_fpscr_pr1 : 0);
+      ii.code_size = c.size;
+      ii.code_match = c.match;
+      ii.code_mask = c.mask;
+
+      ii.format = str (i.format_);
+      ii.abstract = str (i.abstract_);
+      ii.code = str (i.code_);
+      ii.t_bit = str (i.t_bit_.note_);
+      ii.dc_bit = str (i.dc_bit_.note_);
+
+      ii.description = str (trimmed (i.description_));
+      ii.note = str (trimmed (i.note_));
+      ii.operation = str (trimmed (i.operation_));
+      ii.example = str (trimmed (i.example_));
+      ii.exceptions = str (trimmed (i.exceptions_));
+
+      for (int a = SH1; a < __isa_max__; ++a)
+	if (i.is_isa ((isa)a))
+	{
+	  ii.group[a] = str (i.group_.values[a]);
+	  ii.issue[a] = str (i.issue_.values[a]);
+	  ii.latency[a] = str (i.latency_.values[a]);
+	}
+
+      insns.push_back (ii);
+    }
+
+    blocks.push_back (bb);
+  }
+
+  // opcode index.  The candidates for each first word are stored as one
+  // list.  Lists with many 32 bit insns, which are the DSP parallel insns,
+  // are split again by the upper byte of the second word.  The 16 bit insns
+  // of such a list are in all of its parts.  Equal lists and split tables
+  // are stored once.
+  std::vector<shdb::db_opcode_list> opcode_lists;
+  std::vector<uint32_t> opcode_entries;
+  std::map<std::vector<uint32_t>, uint32_t> list_numbers;
+
+  auto add_list = [&] (const std::vector<uint32_t>& l)
+  {
+    auto i = list_numbers.find (l);
+    if (i != list_numbers.end ())
+      return i->second;
+
+    opcode_lists.push_back ({ (uint32_t)opcode_entries.size (), (uint32_t)l.size () });
+    opcode_entries.insert (opcode_entries.end (), l.begin (), l.end ());
+    return list_numbers[l] = opcode_lists.size () - 1;
+  };
+
+  // The split list for each word list that is split.
+  std::vector<uint32_t> opcode_split;
+  std::map<std::vector<uint32_t>, uint32_t> split_lists;
+
+  std::vector<uint32_t> opcode_words (shdb::db_opcode_words);
+  std::vector<std::vector<uint32_t>> word_lists (shdb::db_opcode_words);
+  for (uint32_t n = 0; n < insns.size (); ++n)
+  {
+    const shdb::db_insn& ii = insns[n];
+    if (ii.code_size == 0)
+      continue;
+
+    const uint32_t shift = ii.code_size - 16;
+    const uint32_t match = ii.code_match >> shift;
+    const uint32_t var = ~(ii.code_mask >> shift) & 0xFFFF;
+
+    for (uint32_t v = var; ; v = (v - 1) & var)
+    {
+      word_lists[match | v].push_back (n);
+      if (v == 0)
+	break;
+    }
+  }
+
+  for (uint32_t w = 0; w < shdb::db_opcode_words; ++w)
+  {
+    const std::vector<uint32_t>& l = word_lists[w];
+    const bool split = std::count_if (l.begin (), l.end (), [&] (uint32_t n)
+				      { return insns[n].code_size == 32; })
+		       > shdb::db_opcode_split_size;
+    if (!split)
+    {
+      // Neighboring words mostly have the same list.
+      opcode_words[w] = w > 0 && l == word_lists[w - 1] ? opcode_words[w - 1]
+							 : add_list (l);
+      continue;
+    }
+
+    auto i = split_lists.find (l);
+    if (i == split_lists.end ())
+    {
+      const uint32_t first = opcode_split.size ();
+      for (uint32_t b = 0; b < 256; ++b)
+      {
+	std::vector<uint32_t> sub;
+	for (uint32_t n : l)
+	  if (insns[n].code_size == 16
+	      || (((b << 8) ^ insns[n].code_match) & insns[n].code_mask & 0xFF00) == 0)
+	    sub.push_back (n);
+	opcode_split.push_back (add_list (sub));
+      }
+
+      opcode_lists.push_back ({ first, shdb::db_opcode_split });
+      i = split_lists.insert (std::make_pair (l, opcode_lists.size () - 1)).first;
+    }
+
+    opcode_words[w] = i->second;
+  }
+
+  // mnemonic index.
+  std::vector<std::pair<std::string, uint32_t>> mnemonics;
+  for (const auto& b : insn_blocks)
+    for (const auto& i : b)
+      mnemonics.emplace_back (mnemonic (i.format_), mnemonics.size ());
+  std::stable_sort (mnemonics.begin (), mnemonics.end (),
+		    [] (const std::pair<std::string, uint32_t>& a,
+			const std::pair<std::string, uint32_t>& b)
+		    { return a.first < b.first; });
+
+  std::vector<shdb::db_index_entry> mnemonic_index;
+  for (const auto& m : mnemonics)
+    mnemonic_index.push_back ({ str (m.first), m.second });
+
+  // isa index.
+  std::vector<std::vector<uint32_t>> isa_lists (__isa_max__);
+  for (uint32_t n = 0; n < insns.size (); ++n)
+    for (int a = SH1; a < __isa_max__; ++a)
+      if (insns[n].isa_mask & (1 << a))
+	isa_lists[a].push_back (n);
+  const std::vector<uint32_t> isa_index = db_bucket_index (isa_lists);
+
+  // group index.
+  std::vector<shdb::db_group_entry> group_index;
+  for (uint32_t n = 0; n < insns.size (); ++n)
+    for (uint32_t a = SH1; a < __isa_max__; ++a)
+      if (insns[n].group[a] != 0)
+	group_index.push_back ({ a, insns[n].group[a], n });
+  std::stable_sort (group_index.begin (), group_index.end (),
+		    [&] (const shdb::db_group_entry& a,
+			 const shdb::db_group_entry& b)
+		    {
+		      if (a.isa != b.isa)
+			return a.isa < b.isa;
+		      return std::strcmp (&str.pool[a.group],
+					  &str.pool[b.group]) < 0;
+		    });
+
+  shdb::db_header h;
+  std::memset (&h, 0, sizeof (h));
+  std::memcpy (h.magic, shdb::db_magic, sizeof (h.magic));
+  h.version = shdb::db_version;
+
+  h.isa_count = __isa_max__;
+  h.isa_names_offset = sizeof (h);
+
+  h.block_count = blocks.size ();
+  h.blocks_offset = h.isa_names_offset + sizeof (isa_names);
+
+  h.insn_count = insns.size ();
+  h.insns_offset = h.blocks_offset + blocks.size () * sizeof (shdb::db_block);
+
+  h.opcode_index_offset = h.insns_offset + insns.size () * sizeof (shdb::db_insn);
+  h.opcode_list_count = opcode_lists.size ();
+  h.opcode_split_count = opcode_split.size ();
+  h.opcode_entry_count = opcode_entries.size ();
+
+  h.mnemonic_index_offset = h.opcode_index_offset
+			    + opcode_words.size () * sizeof (uint32_t)
+			    + opcode_lists.size () * sizeof (shdb::db_opcode_list)
+			    + opcode_split.size () * sizeof (uint32_t)
+			    + opcode_entries.size () * sizeof (uint32_t);
+  h.mnemonic_entry_count = mnemonic_index.size ();
+
+  h.isa_index_offset = h.mnemonic_index_offset
+		       + mnemonic_index.size () * sizeof (shdb::db_index_entry);
+  h.isa_entry_count = isa_index.size () - (__isa_max__ + 1);
+
+  h.group_index_offset = h.isa_index_offset
+			 + isa_index.size () * sizeof (uint32_t);
+  h.group_entry_count = group_index.size ();
+
+  h.strings_offset = h.group_index_offset
+		     + group_index.size () * sizeof (shdb::db_group_entry);
+  h.strings_size = str.pool.size ();
+
+  h.file_size = h.strings_offset + h.strings_size;
+
+  out_buffer o;
+  o.data.reserve (h.file_size);
+  o.data.append ((const char*)&h, sizeof (h));
+  o.data.append ((const char*)isa_names.data (), sizeof (isa_names));
+  o.data.append ((const char*)blocks.data (),
+		 blocks.size () * sizeof (shdb::db_block));
+  o.data.append ((const char*)insns.data (),
+		 insns.size () * sizeof (shdb::db_insn));
+  o.data.append ((const char*)opcode_words.data (),
+		 opcode_words.size () * sizeof (uint32_t));
+  o.data.append ((const char*)opcode_lists.data (),
+		 opcode_lists.size () * sizeof (shdb::db_opcode_list));
+  o.data.append ((const char*)opcode_split.data (),
+		 opcode_split.size () * sizeof (uint32_t));
+  o.data.append ((const char*)opcode_entries.data (),
+		 opcode_entries.size () * sizeof (uint32_t));
+  o.data.append ((const char*)mnemonic_index.data (),
+		 mnemonic_index.size () * sizeof (shdb::db_index_entry));
+  o.data.append ((const char*)isa_index.data (),
+		 isa_index.size () * sizeof (uint32_t));
+  o.data.append ((const char*)group_index.data (),
+		 group_index.size () * sizeof (shdb::db_group_entry));
+  o.data.append (str.pool);
+
+  o.write (f);
+}
+
+// Writes one of the exports to a file.  Returns false on failure.
+bool export_file (const char* fn, void (*exporter) (std::ostream&))
+{
+  std::ofstream f (fn, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (f.good ())
+    exporter (f);
+
+  if (!f.good ())
+  {
+    std::cerr << "failed to write " << fn << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+// Opcode space check.
+//
+// Two insns of the same ISA conflict if an instruction word matches both of
+// their codes.  A 32 bit insn conflicts with a 16 bit insn if its first word
+// matches.  Exceptions are
+//   - the FPSCR mode aliases listed in 'fpscr_mode_aliases', which are
+//     selected by different FPSCR.SZ / FPSCR.PR modes.
+//   - the DSP codes with '*' bits, which are parts of parallel instructions.
+//     The '*' bits belong to the other parts, so two such codes only conflict
+//     if they both use a bit that is not a common fixed bit.
+// Any other conflict makes the decoders ambiguous and fails the generation.
+
+// The mnemonics of the insns that share their codes in different FPSCR
+// modes.
+const char* const fpscr_mode_aliases[][2] =
+{
+  { "fabs", "fabs" },
+  { "fadd", "fadd" },
+  { "fcmp/eq", "fcmp/eq" },
+  { "fcmp/gt", "fcmp/gt" },
+  { "fdiv", "fdiv" },
+  { "float", "float" },
+  { "fmov", "fmov" },
+  { "fmov.s", "fmov.d" },
+  { "fmul", "fmul" },
+  { "fneg", "fneg" },
+  { "fsqrt", "fsqrt" },
+  { "fsub", "fsub" },
+  { "ftrc", "ftrc" }
+};
+
+struct opcode_entry
+{
+  opcode_entry (const insn& ii, const insns& b)
+  : i (&ii), mode (b.title_), code (ii.code_)
+  {
+  }
+
+  // The code of the first 16 bit word.
+  uint32_t word_match (void) const { return code.match >> (code.size - 16); }
+  uint32_t word_mask (void) const { return code.mask >> (code.size - 16); }
+  uint32_t word_used (void) const { return code.used >> (code.size - 16); }
+
+  const insn* i;
+  fpscr_mode mode;
+  code_pattern code;
+};
+
+bool is_fpscr_mode_alias (const opcode_entry& a, const opcode_entry& b)
+{
+  if (a.mode.compatible (b.mode))
+    return false;
+
+  const std::string ma = mnemonic (a.i->format_);
+  const std::string mb = mnemonic (b.i->format_);
+  for (const auto& m : fpscr_mode_aliases)
+    if ((ma == m[0] && mb == m[1]) || (ma == m[1] && mb == m[0]))
+      return true;
+  return false;
+}
+
+bool codes_overlap (const opcode_entry& a, const opcode_entry& b)
+{
+  uint32_t am = a.code.match, ak = a.code.mask, au = a.code.used;
+  uint32_t bm = b.code.match, bk = b.code.mask, bu = b.code.used;
+
+  if (a.code.size != b.code.size)
+  {
+    am = a.word_match (); ak = a.word_mask (); au = a.word_used ();
+    bm = b.word_match (); bk = b.word_mask (); bu = b.word_used ();
+  }
+
+  if (((am ^ bm) & ak & bk) != 0)
+    return false;
+
+  const uint32_t all = a.code.size == b.code.size
+		       ? (uint32_t)((1ull << a.code.size) - 1) : 0xFFFF;
+  if ((au == all && bu == all) || (am == bm && ak == bk && au == bu))
+    return true;
+
+  return (au & bu & ~(ak & bk)) != 0;
+}
+
+bool codes_conflict (const opcode_entry& a, const opcode_entry& b)
+{
+  return codes_overlap (a, b) && !is_fpscr_mode_alias (a, b);
+}
+
+enum opcode_state
+{
+  opcode_free,
+  opcode_used,
+  opcode_32_bit_prefix,
+  opcode_conflict
+};
+
+struct opcode_space
+{
+  opcode_space (isa a) : isa_ (a), state (0x10000, opcode_free) { }
+
+  // Marks the instruction words that match the 16 bit pattern.
+  void mark (uint32_t match, uint32_t mask, opcode_state s)
+  {
+    const uint32_t var = ~mask & 0xFFFF;
+    for (uint32_t v = var; ; v = (v - 1) & var)
+    {
+      uint8_t& st = state[match | v];
+      st = std::max<uint8_t> (st, s);
+      if (v == 0)
+	break;
+    }
+  }
+
+  isa isa_;
+  std::vector<uint8_t> state;
+  std::vector<std::pair<const opcode_entry*, const opcode_entry*>> conflicts;
+  std::vector<opcode_entry> entries;
+};
+
+std::vector<opcode_space> check_opcode_space (void)
+{
+  std::vector<opcode_space> r;
+
+  for (int a = SH1; a < __isa_max__; ++a)
+  {
+    r.emplace_back ((isa)a);
+    opcode_space& s = r.back ();
+
+    for (const auto& b : insn_blocks)
+      for (const auto& i : b)
+	if (i.is_isa ((isa)a) && *i.code_ != '\0')
+	  s.entries.emplace_back (i, b);
+
+    for (const auto& e : s.entries)
+      s.mark (e.word_match (), e.word_mask (),
+	      e.code.size == 16 ? opcode_used : opcode_32_bit_prefix);
+
+    for (size_t x = 0; x < s.entries.size (); ++x)
+      for (size_t y = x + 1; y < s.entries.size (); ++y)
+	if (codes_conflict (s.entries[x], s.entries[y]))
+	{
+	  const opcode_entry& ex = s.entries[x];
+	  const opcode_entry& ey = s.entries[y];
+	  s.conflicts.emplace_back (&ex, &ey);
+
+	  // Only the overlap of the fixed bits is marked.
+	  s.mark (ex.word_match () | ey.word_match (),
+		  ex.word_mask () | ey.word_mask (), opcode_conflict);
+	}
+  }
+
+  return r;
+}
+
+std::string opcode_conflict_str (const opcode_space& s, const opcode_entry& a,
+				 const opcode_entry& b)
+{
+  std::string r = isa_name[s.isa_];
+  for (const opcode_entry* e : { &a, &b })
+  {
+    r += e == &a ? ": " : " <-> ";
+    r.append (e->i->format_.str, e->i->format_.size);
+    r += " [";
+    r.append (e->i->code_.str, e->i->code_.size);
+    r += ']';
+  }
+  for (char& c : r)
+    if (c == '\t' || c == '\n')
+      c = ' ';
+  return r;
+}
+
+// Writes the opcode usage of each ISA and a map of the 16 bit opcode space.
+// The map rows are the instruction word bits 15-12 and 7-6, the columns are
+// the bits 5-0.  Each character stands for the 16 instruction words that
+// differ in the bits 11-8, which is the Rn field of most formats.
+void export_opcode_map (std::ostream& f)
+{
+  out_buffer o;
+
+  for (const auto& s : check_opcode_space ())
+  {
+    size_t count[4] = { };
+    for (uint8_t st : s.state)
+      count[st]++;
+
+    o << isa_name[s.isa_] << "\n"
+      << "  16 bit insns:         " << std::to_string (count[opcode_used]) << "\n"
+      << "  32 bit insn prefixes: " << std::to_string (count[opcode_32_bit_prefix]) << "\n"
+      << "  conflicting:          " << std::to_string (count[opcode_conflict]) << "\n"
+      << "  free:                 " << std::to_string (count[opcode_free]) << "\n";
+
+    for (const auto& c : s.conflicts)
+      o << "  conflict " << opcode_conflict_str (s, *c.first, *c.second) << "\n";
+
+    o << "\n  ' ' free  '.' partially used  '#' used  '=' 32 bit prefix"
+	 "  'X' conflict\n\n";
+
+    for (uint32_t row = 0; row < 64; ++row)
+    {
+      const uint32_t row_bits = ((row >> 2) << 12) | ((row & 3) << 6);
+
+      char addr[8];
+      std::snprintf (addr, sizeof (addr), "%Xn%02X", row >> 2, row_bits & 0xFF);
+      o << "  " << std::string (addr) << " |";
+
+      for (uint32_t col = 0; col < 64; ++col)
+      {
+	size_t n[4] = { };
+	for (uint32_t k = 0; k < 16; ++k)
+	  n[s.state[row_bits | (k << 8) | col]]++;
+
+	o << (n[opcode_conflict] ? 'X'
+	      : n[opcode_32_bit_prefix] ? '='
+	      : n[opcode_free] == 16 ? ' '
+	      : n[opcode_free] == 0 ? '#' : '.');
+      }
+      o << "|\n";
+    }
+    o << "\n";
+  }
+
+  o.write (f);
+}
+
+
+// ----------------------------------------------------------------------------
+// Micro-benchmarks to check the issue and latency cycles on real hardware.
+// For one ISA, each insn that has only register and immediate operands gets
+// these benchmarks:
+//   - latency: a chain of the insn where each insn uses the result of the
+//     previous one.  Only for insns that write one of their operands.
+//   - throughput: the insn on rotating registers without dependencies.
+//   - pair (SH4 only): the insn interleaved with an insn of each group, which
+//     checks the dual issue rules.
+// Each benchmark is an assembler function that runs a loop of 32 copies of
+// its body.  microbench.cpp runs them on the target and microbench.sh
+// compares the measured cycles with the table.
+
+enum { mb_unroll = 32 };
+
+enum mb_operand_kind
+{
+  mb_unsupported,
+  mb_fixed,	// R0, FR0, FPUL, MACH, MACL, XMTRX
+  mb_imm,
+  mb_r,
+  mb_fr,
+  mb_dr,
+  mb_xd,
+  mb_fv
+};
+
+struct mb_operand
+{
+  mb_operand_kind kind;
+  std::string name;	// as in the format, e.g. "Rm"
+};
+
+std::vector<mb_operand> mb_operands (const char* format)
+{
+  static const char* const fixed[] = { "R0", "FR0", "FPUL", "MACH", "MACL", "XMTRX" };
+  static const char* const regs[] = { "R", "FR", "DR", "XD", "FV" };
+
+  std::vector<mb_operand> r;
+  std::string ops = trimmed (format + mnemonic (format).size ());
+
+  for (size_t p = 0; p < ops.size (); )
+  {
+    size_t e = std::min (ops.find (',', p), ops.size ());
+    mb_operand o = { mb_unsupported, trimmed (ops.substr (p, e - p).c_str ()) };
+    p = e + 1;
+
+    for (const char* f : fixed)
+      if (o.name == f)
+	o.kind = mb_fixed;
+    for (int k = 0; k < 5; ++k)
+      if (o.name == std::string (regs[k]) + "m" || o.name == std::string (regs[k]) + "n")
+	o.kind = (mb_operand_kind)(mb_r + k);
+    if (o.name.compare (0, 4, "#imm") == 0)
+      o.kind = mb_imm;
+
+    r.push_back (o);
+  }
+  return r;
+}
+
+// The registers that the variable operands of a kind are assigned from.  The
+// two insns of a pair use the low (half = 0) and high (half = 1) registers,
+// so that they don't depend on each other.
+std::vector<std::string> mb_registers (mb_operand_kind k, int half)
+{
+  struct pool { const char* prefix; int first, last, step; };
+  static const pool pools[] =
+  {
+    { "r", 1, 12, 1 }, { "fr", 1, 15, 1 }, { "dr", 2, 14, 2 },
+    { "xd", 0, 14, 2 }, { "fv", 0, 12, 4 }
+  };
+
+  const pool& p = pools[k - mb_r];
+  const int split = k == mb_r ? 7 : 8;
+
+  std::vector<std::string> r;
+  for (int n = p.first; n <= p.last; n += p.step)
+    if (half < 0 || (half == 0) == (n < split))
+      r.push_back (p.prefix + std::to_string (n));
+  return r;
+}
+
+// Returns true if 'name' appears in 's' as a word of its own.
+bool mb_has_word (const std::string& s, const std::string& name, size_t from = 0)
+{
+  for (size_t p = s.find (name, from); p != std::string::npos;
+       p = s.find (name, p + 1))
+    if ((p == 0 || !std::isalnum (s[p - 1]))
+	&& (p + name.size () == s.size () || !std::isalnum (s[p + name.size ()])))
+      return true;
+  return false;
+}
+
+// The fixed registers and the T bit that an insn reads and writes.  They
+// are taken from the abstract, e.g. "Rn + Rm + T -> Rn, carry -> T", where
+// the words left of "->" are read and the words right of it are written.
+// Shifts and rotates such as "T << Rn << T" read the register that is
+// shifted in.  MAC stands for MACH and MACL.  The T bit is also written if
+// the insn has a T bit result.
+struct mb_fixed_access
+{
+  std::set<std::string> reads;
+  std::set<std::string> writes;
+
+  // Returns true if the insn reads a fixed register that it writes, so that
+  // insns of a stream depend on each other.
+  bool is_chain (void) const
+  {
+    for (const auto& r : reads)
+      if (writes.count (r) != 0)
+	return true;
+    return false;
+  }
+
+  // Returns true if the insns share any fixed register.
+  bool overlaps (const mb_fixed_access& a) const
+  {
+    for (const std::set<std::string>* x : { &reads, &writes })
+      for (const auto& r : *x)
+	if (a.reads.count (r) != 0 || a.writes.count (r) != 0)
+	  return true;
+    return false;
+  }
+};
+
+mb_fixed_access mb_fixed_registers (const insn& i)
+{
+  static const char* const fixed[] =
+  {
+    "R0", "FR0", "FPUL", "MACH", "MACL", "MAC", "XMTRX", "FPSCR", "T"
+  };
+
+  mb_fixed_access r;
+  auto add = [] (std::set<std::string>& s, const std::string& text)
+  {
+    for (const char* f : fixed)
+      if (mb_has_word (text, f))
+      {
+	if (std::strcmp (f, "MAC") == 0)
+	{
+	  s.insert ("MACH");
+	  s.insert ("MACL");
+	}
+	else
+	  s.insert (f);
+      }
+  };
+
+  const std::string a = i.abstract_;
+  for (size_t p = 0; p < a.size (); )
+  {
+    const size_t e = std::min (a.find_first_of (",\n", p), a.size ());
+    const std::string st = a.substr (p, e - p);
+    p = e + 1;
+
+    const size_t arrow = st.rfind ("->");
+    const size_t left = st.find ("<<");
+    const size_t right = st.find (">>");
+    if (arrow != std::string::npos)
+    {
+      add (r.reads, st.substr (0, arrow));
+      add (r.writes, st.substr (arrow + 2));
+    }
+    else if (left != std::string::npos)
+    {
+      add (r.writes, st.substr (0, left));
+      add (r.reads, st.substr (st.rfind ("<<") + 2));
+    }
+    else if (right != std::string::npos)
+    {
+      add (r.reads, st.substr (0, right));
+      add (r.writes, st.substr (st.rfind (">>") + 2));
+    }
+  }
+
+  if (i.t_bit_.note_.size != 0)
+    r.writes.insert ("T");
+
+  // The abstract of div1 doesn't mention the T bit that it reads.
+  if (mnemonic (i.format_) == "div1")
+    r.reads.insert ("T");
+
+  return r;
+}
+
+// Returns true if a chain of the insn is a chain of dependent insns.  The
+// destination is taken from the abstract, e.g. "Rn + Rm -> Rn".  Shifts and
+// rotates have no "->" in the abstract and modify their only operand.  An
+// insn that reads a fixed register or the T bit that it writes, e.g. addc
+// or "and #imm,R0", always depends on the previous one.
+bool mb_has_dependency (const insn& i, const std::vector<mb_operand>& ops)
 {
-  SH_NONE = 0,
+  if (mb_fixed_registers (i).is_chain ())
+    return true;
 
-  SH1,
-  SH2,
-  SH2E,
-  SH2A,
-  SH3,
-  SH3E,
-  SH4,
-  SH4A,
+  if (ops.empty () || ops.back ().kind == mb_imm)
+    return false;
 
-  SH_DSP,
+  const mb_operand& dst = ops.back ();
+  std::string a = trimmed (i.abstract_);
+  a = a.substr (0, a.find ('\n'));
 
-  __isa_max__,
-};
+  size_t p = a.rfind ("->");
+  if (p == std::string::npos)
+    return dst.kind >= mb_r;
 
-const struct any_isa { } SH_ANY;
+  std::string lhs = a.substr (0, p);
+  std::string rhs = trimmed (a.c_str () + p + 2);
+  if (rhs.compare (0, dst.name.size (), dst.name) != 0
+      || !mb_has_word (rhs.substr (0, dst.name.size () + 1), dst.name))
+    return false;
 
-struct isa_property
-{
-  isa_property (void)
-  {
-    for (auto& i : values)
-      i = "";
-  }
+  for (const auto& o : ops)
+    if (o.kind == dst.kind && o.kind >= mb_r && o.name.back () == 'm')
+      return true;
 
-  void operator () (void) { }
+  return mb_has_word (lhs, dst.name);
+}
 
-  template <typename... Args> void
-  operator () (isa f, const char* val, Args&&... args)
-  {
-    values[(int)f] = val;
-    (*this) (std::forward<Args> (args)...);
-  }
+// Returns the assembler text of the k-th copy of the insn in a loop body.  In
+// a chain the 'm' and 'n' registers of a kind alternate, so that each insn
+// reads the result of the previous one.  Otherwise the 'n' registers rotate.
+std::string mb_insn_text (const insn& i, const std::vector<mb_operand>& ops,
+			  bool chain, size_t k, int half)
+{
+  std::string r = mnemonic (i.format_);
 
-  template <typename... Args> void
-  operator () (any_isa, const char* val, Args&&... args)
+  for (size_t n = 0; n < ops.size (); ++n)
   {
-    for (auto& v : values)
-      v = val;
-    (*this) (std::forward<Args> (args)...);
-  }
+    const mb_operand& o = ops[n];
+    std::string t;
 
-  template <typename... Args> isa_property (const Args&... args)
-  {
-    for (auto& i : values)
-      i = "";
-    (*this) (args...);
+    if (o.kind == mb_fixed)
+    {
+      t = o.name;
+      std::transform (t.begin (), t.end (), t.begin (), ::tolower);
+    }
+    else if (o.kind == mb_imm)
+      t = "#0";
+    else
+    {
+      std::vector<std::string> regs = mb_registers (o.kind, half);
+      bool has_src = false, has_dst = false;
+      for (const auto& x : ops)
+	if (x.kind == o.kind)
+	  (x.name.back () == 'm' ? has_src : has_dst) = true;
+
+      const bool src = o.name.back () == 'm';
+      if (chain)
+	t = has_src && has_dst ? regs[(k + (src ? 0 : 1)) % 2]
+	    : regs[src ? 1 : 0];
+      else
+	t = src ? regs[0]
+	    : regs[(has_src ? 1 : 0) + k % (regs.size () - (has_src ? 1 : 0))];
+    }
+
+    r += (n == 0 ? "\t" : ",") + t;
   }
+  return r;
+}
 
-  const char* operator[] (isa i) const { return values[(int)i]; }
+// Returns the number of registers that the destination of a throughput
+// stream rotates through, see mb_insn_text, or 0 if there is no register
+// destination.
+size_t mb_stream_registers (const std::vector<mb_operand>& ops)
+{
+  size_t r = 0;
+  for (const auto& o : ops)
+    if (o.kind >= mb_r && o.name.back () == 'n')
+    {
+      bool has_src = false;
+      for (const auto& x : ops)
+	has_src |= x.kind == o.kind && x.name.back () == 'm';
 
-  std::array<const char*, __isa_max__> values;
-};
+      const size_t n = mb_registers (o.kind, -1).size () - (has_src ? 1 : 0);
+      r = r == 0 ? n : std::min (r, n);
+    }
+  return r;
+}
 
-struct group : public isa_property
+// Returns the largest number in a cycles value such as "4/5" or "5-8".
+int mb_max_cycles (const char* s)
 {
-  template <typename... Args> group (Args&&... args)
-  : isa_property (std::forward<Args> (args)...)
-  {
-  }
-};
+  int r = 0;
+  while (*s != '\0')
+    if (std::isdigit (*s))
+    {
+      char* end;
+      r = std::max (r, (int)std::strtol (s, &end, 10));
+      s = end;
+    }
+    else
+      ++s;
+  return r;
+}
 
-struct issue : public isa_property
+// Returns true if 's' is a plain number of cycles.
+bool mb_cycles (const char* s, int& n)
 {
-  template <typename... Args> issue (Args&&... args)
-  : isa_property (std::forward<Args> (args)...)
-  {
-  }
-};
+  char* end;
+  n = (int)std::strtol (s, &end, 10);
+  return *s != '\0' && *end == '\0';
+}
 
-struct latency : public isa_property
+struct microbench
 {
-  template <typename... Args> latency (Args&&... args)
-  : isa_property (std::forward<Args> (args)...)
-  {
-  }
+  std::string id;
+  std::string kind;		// "latency", "throughput" or "pair"
+  std::string insn;		// the format of the benchmarked insn(s)
+  std::string claimed;		// the cycles in the table
+  fpscr_mode mode = fpscr_mode ("");
+  std::vector<std::string> body;
 };
 
-isa_property isa_name = isa_property
-(
-  SH1, "SH1",
-  SH2, "SH2",
-  SH2E, "SH2E",
-  SH2A, "SH2A",
-  SH3, "SH3",
-  SH3E, "SH3E",
-  SH4, "SH4",
-  SH4A, "SH4A",
-  SH_DSP, "DSP"
-);
+// The ISA for --microbench.
+isa microbench_isa = SH4;
 
-const struct privileged_tag { } privileged;
+bool find_isa (const char* name, isa& a)
+{
+  for (int n = SH1; n < __isa_max__; ++n)
+    if (std::strcmp (isa_name.values[n], name) == 0)
+    {
+      a = (isa)n;
+      return true;
+    }
+  return false;
+}
 
-struct t_bit
+// Insns that change the control flow, the FPSCR mode or the repeat registers
+// can't be run in a loop.
+bool mb_excluded (const std::string& m)
 {
-  t_bit (void) { }
+  static const char* const excluded[] =
+  {
+    "braf", "bsrf", "rts", "rts/n", "rtv/n", "rte", "sleep", "trapa",
+    "fschg", "frchg", "fpchg", "resbank", "setrc", "ldrc"
+  };
+  for (const char* e : excluded)
+    if (m == e)
+      return true;
+  return false;
+}
 
-  t_bit (const char* note)
-  : note_ (note)
+std::vector<microbench> microbenchmarks (isa a)
+{
+  struct candidate
+  {
+    const insn* i;
+    std::vector<mb_operand> ops;
+    fpscr_mode mode;
+    uint32_t number;
+    mb_fixed_access fixed;
+  };
+
+  std::vector<candidate> insns;
+  uint32_t number = 0;
+  for (const auto& b : insn_blocks)
   {
+    fpscr_mode mode (b.title_);
+    for (const auto& i : b)
+    {
+      const uint32_t n = number++;
+      if (!i.is_isa (a) || i.privileged_ || *i.code_ == '\0'
+	  || std::strchr (i.code_, '*') != nullptr
+	  || mb_excluded (mnemonic (i.format_)))
+	continue;
+
+      std::vector<mb_operand> ops = mb_operands (i.format_);
+      if (std::none_of (ops.begin (), ops.end (), [] (const mb_operand& o)
+			{ return o.kind == mb_unsupported; }))
+	insns.push_back ({ &i, ops, mode, n, mb_fixed_registers (i) });
+    }
   }
 
-  const char* note_ = "";
-};
+  auto format = [] (const insn& i)
+  {
+    std::string f = i.format_;
+    std::replace (f.begin (), f.end (), '\t', ' ');
+    return f;
+  };
 
-struct dc_bit
-{
-  dc_bit (void) { }
-  dc_bit (const char* note)
-  : note_ (note)
+  std::vector<microbench> r;
+
+  for (const auto& c : insns)
   {
-  }
-  const char* note_ = "";
-};
+    const std::string n = std::to_string (c.number);
 
-struct insn
-{
-  void operator () (void) { }
-  void operator () (const format& p) { format_ = p.value; }
-  void operator () (const abstract& p) { abstract_ = p.value; }
-  void operator () (const code& p) { code_ = p.value; }
-  void operator () (const description& p) { description_ = p.value; }
-  void operator () (const note& p) { note_ = p.value; }
-  void operator () (const operation& p) { operation_ = p.value; }
-  void operator () (const example& p) { example_ = p.value; }
-  void operator () (const exceptions& p) { exceptions_ = p.value; }
-  void operator () (isa i) { isa_ |= (1 << (int)i); }
-  void operator () (any_isa) { isa_ = -1 & ~((1 << (int)SH_DSP) | (1 << (int)SH2E) | (1 << (int)SH3E)); }
-  void operator () (const group& g) { group_ = g; }
-  void operator () (const issue& i) { issue_ = i; }
-  void operator () (const latency& l) { latency_ = l; }
-  void operator () (privileged_tag) { privileged_ = true; }
-  void operator () (const t_bit& t) { t_bit_ = t; }
-  void operator () (const dc_bit& dc) { dc_bit_ = dc; }
+    if (mb_has_dependency (*c.i, c.ops))
+    {
+      microbench m;
+      m.id = "latency_" + n;
+      m.kind = "latency";
+      m.insn = format (*c.i);
+      m.claimed = c.i->latency_[a].str;
+      m.mode = c.mode;
+      for (size_t k = 0; k < mb_unroll; ++k)
+	m.body.push_back (mb_insn_text (*c.i, c.ops, true, k, -1));
+      r.push_back (m);
+    }
 
-  template <typename T> void operator () (const T&);
+    // With fewer destination registers than the latency, e.g. the four FV
+    // registers of fipr and ftrv, the stream would be a dependency chain.
+    // Streams of insns that read a fixed register or the T bit that they
+    // write are dependency chains too, see mb_has_dependency.
+    const size_t stream_regs = mb_stream_registers (c.ops);
+    if ((stream_regs != 0 && stream_regs < (size_t)mb_max_cycles (c.i->latency_[a]))
+	|| c.fixed.is_chain ())
+      continue;
+
+    microbench m;
+    m.id = "throughput_" + n;
+    m.kind = "throughput";
+    m.insn = format (*c.i);
+    m.claimed = c.i->issue_[a].str;
+    m.mode = c.mode;
+    for (size_t k = 0; k < mb_unroll; ++k)
+      m.body.push_back (mb_insn_text (*c.i, c.ops, false, k, -1));
+    r.push_back (m);
+  }
 
-  template <typename T, typename... Args> void
-  operator () (const T& a, const Args&... args)
+  if (a != SH4)
+    return r;
+
+  // SH4 issues two insns in parallel if they are in different groups or both
+  // in the MT group, unless one of them is in the CO group.  Each insn is
+  // paired with the first insn of each group that doesn't use any of its
+  // fixed registers or the T bit, so that the two insns are independent.
+  std::map<std::string, std::vector<const candidate*>> groups;
+  for (const auto& c : insns)
   {
-    (*this) (a);
-    (*this) (args...);
+    int cycles;
+    if (*c.i->group_[a] != '\0' && mb_cycles (c.i->issue_[a], cycles))
+      groups[c.i->group_[a].str].push_back (&c);
   }
 
-  template <typename... Args> insn (const char* format, const Args&... args)
-  : format_ (format)
+  for (const auto& c : insns)
   {
-    (*this) (args...);
+    const std::string g0 = c.i->group_[a];
+    int cycles0;
+    if (g0.empty () || !mb_cycles (c.i->issue_[a], cycles0))
+      continue;
+
+    for (const auto& g : groups)
+    {
+      auto partner = std::find_if (g.second.begin (), g.second.end (),
+				   [&c] (const candidate* p)
+				   {
+				     return c.mode.compatible (p->mode)
+					    && !c.fixed.overlaps (p->fixed);
+				   });
+      if (partner == g.second.end ())
+	continue;
+
+      const candidate& p = **partner;
+      int cycles1;
+      mb_cycles (p.i->issue_[a], cycles1);
+
+      const bool parallel = g0 != "CO" && g.first != "CO"
+			    && (g0 != g.first || g0 == "MT");
+
+      microbench m;
+      m.id = "pair_" + std::to_string (c.number) + "_" + g.first;
+      m.kind = "pair";
+      m.insn = format (*c.i) + " | " + format (*p.i);
+      m.claimed = std::to_string (parallel ? std::max (cycles0, cycles1)
+					   : cycles0 + cycles1);
+      m.mode.sz = c.mode.sz >= 0 ? c.mode.sz : p.mode.sz;
+      m.mode.pr = c.mode.pr >= 0 ? c.mode.pr : p.mode.pr;
+      for (size_t k = 0; k < mb_unroll; ++k)
+      {
+	m.body.push_back (mb_insn_text (*c.i, c.ops, false, k, 0));
+	m.body.push_back (mb_insn_text (*p.i, p.ops, false, k, 1));
+      }
+      r.push_back (m);
+    }
   }
 
-  bool is_isa (isa i) const { return (isa_ & (1 << (int)i)) != 0; }
+  return r;
+}
 
-  int isa_ = 0;
-  bool privileged_ = false;
+// Writes the benchmark functions and the table of them that microbench.cpp
+// uses.  Each function takes the number of loop iterations in r4 and counts
+// them down in r13.  The callee saved registers are saved, r0 - r12 are set
+// to 1 and the FPU registers to 1.0, since denormals and NaNs take a
+// different path on some FPUs.
+void export_microbench_asm (std::ostream& f)
+{
+  const isa a = microbench_isa;
+  const bool fpu = a == SH2E || a == SH2A || a == SH3E || a == SH4 || a == SH4A;
+  const bool xf_bank = a == SH4 || a == SH4A;
 
-  t_bit t_bit_;
-  dc_bit dc_bit_;
+  std::vector<microbench> benchmarks = microbenchmarks (a);
 
-  const char* format_ = "";
-  const char* abstract_ = "";
-  const char* code_ = "";
+  // The empty loop, which is subtracted from the other benchmarks.
+  microbench loop;
+  loop.id = "loop";
+  benchmarks.insert (benchmarks.begin (), loop);
 
-  group group_;
-  issue issue_;
-  latency latency_;
+  out_buffer o;
+  o << "! Generated by 'sh_insns --microbench' for " << isa_name[a] << ".\n"
+       "\n"
+       "#define CONCAT1(a, b) CONCAT2 (a, b)\n"
+       "#define CONCAT2(a, b) a ## b\n"
+       "#define SYM(x) CONCAT1 (__USER_LABEL_PREFIX__, x)\n"
+       "\n"
+       "\t.text\n";
 
-  const char* description_ = "";
-  const char* note_ = "";
-  const char* operation_ = "";
-  const char* example_ = "";
-  const char* exceptions_ = "";
-};
+  for (size_t n = 0; n < benchmarks.size (); ++n)
+  {
+    const microbench& m = benchmarks[n];
 
-struct insns : public std::vector<insn>
-{
-  void operator () (void) { }
-  void operator () (const insn& i) { push_back (i); }
+    o << "\n\t.align 2\n"
+	 ".Lbench_" << std::to_string (n) << ":\t! " << m.id << "\n";
 
-  template <typename T> void operator () (const T&);
+    for (int r = 8; r <= 14; ++r)
+      o << "\tmov.l\tr" << std::to_string (r) << ",@-r15\n";
+    o << "\tsts.l\tmach,@-r15\n"
+	 "\tsts.l\tmacl,@-r15\n"
+	 "\tmov\tr4,r13\n";
 
-  template <typename T, typename... Args> void
-  operator () (const T& a, const Args&... args)
-  {
-    (*this) (a);
-    (*this) (args...);
-  }
+    if (fpu)
+    {
+      o << "\tsts.l\tfpscr,@-r15\n";
+      for (int r = 12; r <= 15; ++r)
+	o << "\tfmov.s\tfr" << std::to_string (r) << ",@-r15\n";
+      o << "\tmov\t#0,r0\n"
+	   "\tlds\tr0,fpscr\n";
+      if (xf_bank)
+      {
+	o << "\tfrchg\n";
+	for (int r = 0; r <= 15; ++r)
+	  o << "\tfldi1\tfr" << std::to_string (r) << "\n";
+	o << "\tfrchg\n";
+      }
+      for (int r = 0; r <= 15; ++r)
+	o << "\tfldi1\tfr" << std::to_string (r) << "\n";
+
+      // FPSCR.DN = 1, FPSCR.PR and FPSCR.SZ as required by the insns.
+      const int fpscr = 4 + (m.mode.pr == 1 ? 8 : 0) + (m.mode.sz == 1 ? 16 : 0);
+      o << "\tmov\t#" << std::to_string (fpscr) << ",r0\n"
+	   "\tshll16\tr0\n"
+	   "\tlds\tr0,fpscr\n";
+    }
 
-  template <typename... Args> insns (const char* title, const Args&... args)
-  : title_ (title)
-  {
-    (*this) (args...);
-  }
+    for (int r = 0; r <= 12; ++r)
+      o << "\tmov\t#1,r" << std::to_string (r) << "\n";
 
-  const char* title_;
-};
+    o << "\t.align 5\n"
+	 "1:\n";
+    for (const auto& b : m.body)
+      o << "\t" << b << "\n";
+    o << "\tdt\tr13\n"
+	 "\tbf\t1b\n";
 
-const insn dummy_insn ("", SH1, SH2, SH2E, SH2A, SH3, SH3E, SH4, SH4A, SH_DSP);
+    if (fpu)
+    {
+      o << "\tmov\t#0,r0\n"
+	   "\tlds\tr0,fpscr\n";
+      for (int r = 15; r >= 12; --r)
+	o << "\tfmov.s\t@r15+,fr" << std::to_string (r) << "\n";
+      o << "\tlds.l\t@r15+,fpscr\n";
+    }
 
-// ----------------------------------------------------------------------------
+    o << "\tlds.l\t@r15+,macl\n"
+	 "\tlds.l\t@r15+,mach\n";
+    for (int r = 14; r >= 8; --r)
+      o << "\tmov.l\t@r15+,r" << std::to_string (r) << "\n";
+    o << "\trts\n"
+	 "\tnop\n";
+  }
 
-std::vector<insns> insn_blocks;
+  // struct microbench { const char* id; void (*run) (unsigned int); unsigned int ops; }
+  // The table holds code and string addresses, which need relocations in
+  // position independent executables, so it goes into .data.rel.ro.
+  o << "\n\t.section .data.rel.ro,\"aw\"\n"
+       "\t.align 2\n"
+       "\t.global SYM (microbench_table)\n"
+       "SYM (microbench_table):\n";
+  for (size_t n = 0; n < benchmarks.size (); ++n)
+    o << "\t.long\t.Lid_" << std::to_string (n) << ",.Lbench_" << std::to_string (n)
+      << "," << std::to_string (mb_unroll) << "\n";
+  o << "\t.long\t0,0,0\n\n"
+       "\t.section .rodata\n";
 
-void build_insn_blocks (void);
+  for (size_t n = 0; n < benchmarks.size (); ++n)
+    o << ".Lid_" << std::to_string (n) << ":\t.asciz\t\"" << benchmarks[n].id << "\"\n";
 
-// ----------------------------------------------------------------------------
+  o.write (f);
+}
 
-enum note_type
+// Writes the claimed cycles of the benchmarks as tab separated lines:
+//   id  kind  insn  claimed
+void export_microbench_expected (std::ostream& f)
 {
-  note_normal,
-  note_code
-};
+  out_buffer o;
+  o << "id\tkind\tinsn\tclaimed\n";
+  for (const auto& m : microbenchmarks (microbench_isa))
+    o << m.id << "\t" << m.kind << "\t" << m.insn << "\t"
+      << (m.claimed.empty () ? "-" : m.claimed) << "\n";
+  o.write (f);
+}
 
-void print_note (const char* name, const char* val, note_type t)
+// ----------------------------------------------------------------------------
+
+void print_insn_blocks (void)
 {
-  // skip leading line breaks in the input string.
-  while (*val != '\0' && *val == '\n')
-    val++;
+  for (const auto& b : insn_blocks)
+  {
+    out << "<br/><b>" << b.title_ << "</b><br/><br/>\n";
 
-  if (std::strlen (val) == 0)
-    return;
+    for (const auto& i : b)
+    {
+      out << "<div class=\"col_cont\" onmouseover=\"on_mouse_over(this);\""
+	     " onmouseout=\"on_mouse_out(this);\" onclick=\"on_mouse_click(this,event);\">" "\n"
+	     "<div class=\"col_cont_1\">";
+      print_isa_compatibility (i);
 
-  std::cout << "<i><b>" << name << "</i></b><br/>";
-  if (t == note_normal)
-    std::cout << val << "<br/><br/>";
-  else if (t == note_code)
-  {
-    std::cout << "<pre><p class=\"precode\">"
-	      << val
-	      << "</p></pre>";
+      out << "</div>" "\n"
+	  << "<div class=\"col_cont_2\">" << i.format_ << "</div>" "\n"
+	  << "<div class=\"col_cont_3\">" << i.abstract_ << "</div>" "\n"
+	  << "<div class=\"col_cont_4\">" << i.code_ << "</div>" "\n"
+	  << "<div class=\"col_cont_5\">";
+      print_t_bit_dc_bit_note (i);
+
+      out << "</div>" "\n" "<div class=\"col_cont_6\">";
+      print_isa_props (i, i.group_);
+
+      out << "</div>" "\n" "<div class=\"col_cont_7\">";
+      print_isa_props (i, i.issue_);
+
+      out << "</div>" "\n" "<div class=\"col_cont_8\">";
+      print_isa_props (i, i.latency_);
+
+      out << "</div>" "\n"
+	     "<div class=\"col_cont_note\" id=\"note\" style=\"display:none\">" "\n";
+
+      print_note ("Description", i.description_, note_normal);
+      print_note ("Note", i.note_, note_normal);
+      print_note ("Operation", i.operation_, note_code);
+      print_note ("Example", i.example_, note_code);
+      print_note ("Possible Exceptions", i.exceptions_, note_normal);
+
+      out << "</div></div>\n";
+    }
   }
 
-  std::cout << "\n\n";
+  print_inline_svg_symbols ();
 }
 
-std::string isa_prop_str (const char* p)
+// ----------------------------------------------------------------------------
+// Benchmark of the stages that run inside the generator.  The stages are run
+// 'runs' times each and the fastest and the median time of the runs are
+// printed as tab separated lines:
+//
+//   stage  scale  insns  runs  min_ms  median_ms
+//
+// For the synthetic inputs the insn blocks are built 'scale' times, so all
+// stages see 'scale' times the number of insns.  bench.sh adds the times of
+// the external preprocessing and compile stages.
+
+double time_ms (const std::function<void (void)>& f)
 {
-  std::string s = p;
-  if (s.size () < 6)
-   s += std::string (6 - s.size (), ' ');
-  return std::move (s);
+  auto start = std::chrono::steady_clock::now ();
+  f ();
+  auto end = std::chrono::steady_clock::now ();
+  return std::chrono::duration<double, std::milli> (end - start).count ();
 }
 
-std::string print_isa_props (const insn& i, const isa_property& p)
+void run_benchmark (int runs, int scale)
 {
-  // this one defines the order of the ISA matrices.
-  std::string r;
-
-  r += isa_prop_str (i.is_isa (SH1) ? p.values[SH1] : "");
-  r += isa_prop_str (i.is_isa (SH2) ? p.values[SH2] : "");
-  r += isa_prop_str (i.is_isa (SH2E) ? p.values[SH2E] : "");
-  r += '\n';
-  r += isa_prop_str (i.is_isa (SH3) ? p.values[SH3] : "");
-  r += isa_prop_str (i.is_isa (SH3E) ? p.values[SH3E] : "");
-  r += isa_prop_str (i.is_isa (SH_DSP) ? p.values[SH_DSP] : "");
-  r += '\n';
-  r += isa_prop_str (i.is_isa (SH4) ? p.values[SH4] : "");
-  r += isa_prop_str (i.is_isa (SH4A) ? p.values[SH4A] : "");
-  r += isa_prop_str (i.is_isa (SH2A) ? p.values[SH2A] : "");
-
-  return std::move (r);
-}
-
-std::string print_isa_compatibility (const insn& i)
-{
-  std::string r;
-
-  r += isa_prop_str (i.is_isa (SH1) ? isa_name[SH1] : "");
-  r += isa_prop_str (i.is_isa (SH2) ? isa_name[SH2] : "");
-  r += isa_prop_str (i.is_isa (SH2E) ? isa_name[SH2E] : "");
-  r += '\n';
-  r += isa_prop_str (i.is_isa (SH3) ? isa_name[SH3] : "");
-  r += isa_prop_str (i.is_isa (SH3E) ? isa_name[SH3E] : "");
-  r += isa_prop_str (i.is_isa (SH_DSP) ? isa_name[SH_DSP] : "");
-  r += '\n';
-  r += isa_prop_str (i.is_isa (SH4) ? isa_name[SH4] : "");
-  r += isa_prop_str (i.is_isa (SH4A) ? isa_name[SH4A] : "");
-  r += isa_prop_str (i.is_isa (SH2A) ? isa_name[SH2A] : "");
+  auto build = [scale] (void)
+  {
+    insn_blocks.clear ();
+    for (int i = 0; i < scale; ++i)
+      build_insn_blocks ();
+  };
 
-  if (i.privileged_)
+  build ();
+  size_t insn_count = 0;
+  for (const auto& b : insn_blocks)
+    insn_count += b.size ();
+
+  auto print = [&] (const char* stage, const std::function<void (void)>& f)
   {
-    r += '\n';
-    r += "Privileged";
-  }
+    std::vector<double> t;
+    for (int r = 0; r < runs; ++r)
+      t.push_back (time_ms (f));
+    std::sort (t.begin (), t.end ());
+
+    const size_t n = t.size ();
+    const double median = n % 2 != 0 ? t[n / 2] : (t[n / 2 - 1] + t[n / 2]) / 2;
+
+    char line[128];
+    std::snprintf (line, sizeof (line), "%s\t%d\t%zu\t%d\t%.3f\t%.3f\n",
+		   stage, scale, insn_count, runs, t.front (), median);
+    std::cout << line;
+  };
 
-  return std::move (r);
+  std::ostringstream sink;
+  auto exporter = [&] (void (*e) (std::ostream&))
+  {
+    return [&sink, e] (void) { sink.str (std::string ()); e (sink); };
+  };
+
+  print ("build_insn_blocks", build);
+  print ("html", [] (void) { out.data.clear (); print_insn_blocks (); });
+  print ("json", exporter (export_json));
+  print ("csv", exporter (export_csv));
+  print ("db", exporter (export_db));
+
+  // The opcode check would only report the copies of the synthetic inputs as
+  // conflicts.
+  if (scale == 1)
+    print ("opcode_check", [] (void) { check_opcode_space (); });
 }
 
-std::string print_t_bit_dc_bit_note (const insn& i)
+int main (int argc, char* argv[])
 {
-  std::string r = i.t_bit_.note_;
-  r += "\n";
-  r += i.dc_bit_.note_;
-/*
-  if (r.empty ())
-    return " ";
-  else */
-    return std::move (r);
-}
+  const char* json_file = nullptr;
+  const char* csv_file = nullptr;
+  const char* db_file = nullptr;
+  const char* opcode_map_file = nullptr;
+  const char* microbench_dir = nullptr;
+  int bench_runs = 0;
+  int bench_scale = 1;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::strcmp (argv[i], "--inline-svg") == 0 && i + 1 < argc)
+      inline_svg_dir = argv[++i];
+    else if (std::strcmp (argv[i], "--json") == 0 && i + 1 < argc)
+      json_file = argv[++i];
+    else if (std::strcmp (argv[i], "--csv") == 0 && i + 1 < argc)
+      csv_file = argv[++i];
+    else if (std::strcmp (argv[i], "--db") == 0 && i + 1 < argc)
+      db_file = argv[++i];
+    else if (std::strcmp (argv[i], "--opcode-map") == 0 && i + 1 < argc)
+      opcode_map_file = argv[++i];
+    else if (std::strcmp (argv[i], "--microbench") == 0 && i + 1 < argc)
+      microbench_dir = argv[++i];
+    else if (std::strcmp (argv[i], "--microbench-isa") == 0 && i + 1 < argc
+	     && find_isa (argv[++i], microbench_isa))
+      ;
+    else if (std::strcmp (argv[i], "--bench") == 0 && i + 1 < argc
+	     && (bench_runs = std::atoi (argv[++i])) > 0)
+      ;
+    else if (std::strcmp (argv[i], "--bench-scale") == 0 && i + 1 < argc
+	     && (bench_scale = std::atoi (argv[++i])) > 0)
+      ;
+    else
+    {
+      std::cerr << "usage: " << argv[0] << " [--inline-svg dir]"
+		   " [--json file] [--csv file] [--db file]"
+		   " [--opcode-map file] [--microbench dir [--microbench-isa isa]]"
+		   " [--bench runs [--bench-scale n]]"
+		<< std::endl;
+      return 1;
+    }
+  }
 
+  if (bench_runs > 0)
+  {
+    run_benchmark (bench_runs, bench_scale);
+    return 0;
+  }
 
-int main (void)
-{
-  std::cout << R"html(
+  // Roughly the size of the generated page.
+  out.data.reserve (1 << 20);
+
+  out << R"html(
 
 <?xml version="1.0" encoding="UTF-8"?>
 <!DOCTYPE html PUBLIC "-//W3C//DTD XHTML 1.0 Strict//EN" "DTD/xhtml1-strict.dtd">
@@ -618,7 +2335,7 @@ function on_mouse_click (div_obj, event)
 </div>
 
 <div style="float:right">
-Last updated: )html" << __DATE__ << " " << __TIME__ << R"html(
+Last updated: )html" __DATE__ " " __TIME__ R"html(
 
 </div>
 <br/>
@@ -640,55 +2357,58 @@ Last updated: )html" << __DATE__ << " " << __TIME__ << R"html(
 
 )html"
 
-<< "\n<div class=\"col_head_5\"><b><i>T Bit</br>DC Bit</b></i>"
-   "\n<div class=\"cpu_cols\">" << " " << "</div></div>"
+  "\n<div class=\"col_head_5\"><b><i>T Bit</br>DC Bit</b></i>"
+  "\n<div class=\"cpu_cols\">" " " "</div></div>"
+  "\n<div class=\"col_head_6\"><b><i>Instruction Group</b></i>"
+  "\n<div class=\"cpu_cols\">";
+  print_isa_props (dummy_insn, isa_name);
 
-   "\n<div class=\"col_head_6\"><b><i>Instruction Group</b></i>"
-   "\n<div class=\"cpu_cols\">" << print_isa_props (dummy_insn, isa_name) << "</div></div>"
+  out << "</div></div>"
+	 "\n<div class=\"col_head_7\"><b><i>Issue Cycles</b></i>"
+	 "\n<div class=\"cpu_cols\">";
+  print_isa_props (dummy_insn, isa_name);
 
-   "\n<div class=\"col_head_7\"><b><i>Issue Cycles</b></i>"
-   "\n<div class=\"cpu_cols\">" << print_isa_props (dummy_insn, isa_name) << "</div></div>"
+  out << "</div></div>"
+	 "\n<div class=\"col_head_8\"><b><i>Latency Cycles</b></i>"
+	 "\n<div class=\"cpu_cols\">";
+  print_isa_props (dummy_insn, isa_name);
 
-   "\n<div class=\"col_head_8\"><b><i>Latency Cycles</b></i>"
-   "\n<div class=\"cpu_cols\">" << print_isa_props (dummy_insn, isa_name) << "</div></div>"
-
-   "\n</div></div>" << std::endl;
+  out << "</div></div>"
+	 "\n</div></div>\n";
 
   build_insn_blocks ();
 
-  std::cout << "<div class=main id=\"main\">" << std::endl;
+  bool conflicts = false;
+  for (const auto& s : check_opcode_space ())
+    for (const auto& c : s.conflicts)
+    {
+      std::cerr << "error: opcode conflict "
+		<< opcode_conflict_str (s, *c.first, *c.second) << std::endl;
+      conflicts = true;
+    }
+  if (conflicts)
+    return 1;
 
+  out << "<div class=main id=\"main\">\n";
 
-  for (const auto& b : insn_blocks)
-  {
-    std::cout << "<br/><b>" << b.title_ << "</b><br/><br/>" << std::endl;
 
-    for (const auto& i : b)
-    {
-      std::cout
-	<< "<div class=\"col_cont\" onmouseover=\"on_mouse_over(this);\""
-	   " onmouseout=\"on_mouse_out(this);\" onclick=\"on_mouse_click(this,event);\">" "\n"
-	<< "<div class=\"col_cont_1\">" << print_isa_compatibility (i) << "</div>" "\n"
-	<< "<div class=\"col_cont_2\">" << i.format_ << "</div>" "\n"
-	<< "<div class=\"col_cont_3\">" << i.abstract_ << "</div>" "\n"
-	<< "<div class=\"col_cont_4\">" << i.code_ << "</div>" "\n"
-	<< "<div class=\"col_cont_5\">" << print_t_bit_dc_bit_note (i) << "</div>" "\n"
-	<< "<div class=\"col_cont_6\">" << print_isa_props (i, i.group_) << "</div>" "\n"
-	<< "<div class=\"col_cont_7\">" << print_isa_props (i, i.issue_) << "</div>" "\n"
-	<< "<div class=\"col_cont_8\">" << print_isa_props (i, i.latency_) << "</div>" "\n"
-	<< "<div class=\"col_cont_note\" id=\"note\" style=\"display:none\">" "\n";
+  print_insn_blocks ();
 
-      print_note ("Description", i.description_, note_normal);
-      print_note ("Note", i.note_, note_normal);
-      print_note ("Operation", i.operation_, note_code);
-      print_note ("Example", i.example_, note_code);
-      print_note ("Possible Exceptions", i.exceptions_, note_normal);
+  out << "</div></body></html>\n";
+  out.write (std::cout);
 
-      std::cout << "</div></div>" << std::endl;
-    }
-  }
+  if ((json_file != nullptr && !export_file (json_file, export_json))
+      || (csv_file != nullptr && !export_file (csv_file, export_csv))
+      || (db_file != nullptr && !export_file (db_file, export_db))
+      || (opcode_map_file != nullptr
+	  && !export_file (opcode_map_file, export_opcode_map))
+      || (microbench_dir != nullptr
+	  && (!export_file ((std::string (microbench_dir) + "/microbench.S").c_str (),
+			    export_microbench_asm)
+	      || !export_file ((std::string (microbench_dir) + "/expected.tsv").c_str (),
+			       export_microbench_expected))))
+    return 1;
 
-  std::cout << "</div></body></html>" << std::endl;
   return 0;
 }
 
@@ -11025,7 +12745,7 @@ void LDSMDSR (int m)
 (insn "lds	Rm,A0"
   SH_DSP
   (abstract "Rm -> A0")
-  (code "0100mmmm01110110")
+  (code "0100mmmm01111010")
 
   (issue SH_DSP "1")
   (latency SH_DSP "1")
@@ -13693,7 +15413,7 @@ void STSA0 (int n)
 (insn "sts.l	A0,@-Rn"
   SH_DSP
   (abstract "Rn-4 -> Rn, A0 -> (Rn)")
-  (code "0100nnnn01100010")
+  (code "0100nnnn01110010")
 
   (issue SH_DSP "1")
   (latency SH_DSP "1")
@@ -0,0 +1,422 @@
+/*
+shdb - Read-only access to the binary SH instruction database.
+
+This is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this software; see the file LICENSE.  If not see
+<http://www.gnu.org/licenses/>.
+
+*/
+
+#include "shdb.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace shdb
+{
+
+// ----------------------------------------------------------------------------
+
+insn::insn (const database& db, uint32_t n)
+: db_ (&db), rec_ (&db.record (n)), number_ (n)
+{
+}
+
+const char* insn::str (uint32_t ref) const
+{
+  return db_->str (ref);
+}
+
+const char* insn::block_title (void) const
+{
+  return db_->block_title (rec_->block);
+}
+
+bool insn::is_isa (int isa) const
+{
+  return isa >= 0 && isa < db_isa_count && (rec_->isa_mask & (1u << isa)) != 0;
+}
+
+bool insn::is_privileged (void) const
+{
+  return (rec_->flags & db_insn_privileged) != 0;
+}
+
+int insn::fpscr_sz (void) const
+{
+  return rec_->flags & db_insn_fpscr_sz0 ? 0
+	 : rec_->flags & db_insn_fpscr_sz1 ? 1 : -1;
+}
+
+int insn::fpscr_pr (void) const
+{
+  return rec_->flags & db_insn_fpscr_pr0 ? 0
+	 : rec_->flags & db_insn_fpscr_pr1 ? 1 : -1;
+}
+
+bool insn::is_fpscr_mode (int sz, int pr) const
+{
+  return (sz < 0 || fpscr_sz () < 0 || fpscr_sz () == sz)
+	 && (pr < 0 || fpscr_pr () < 0 || fpscr_pr () == pr);
+}
+
+bool insn::matches (uint16_t w0, uint16_t w1) const
+{
+  if (rec_->code_size == 16)
+    return (w0 & rec_->code_mask) == rec_->code_match;
+  if (rec_->code_size == 32)
+    return ((((uint32_t)w0 << 16) | w1) & rec_->code_mask) == rec_->code_match;
+  return false;
+}
+
+const char* insn::group (int isa) const
+{
+  return is_isa (isa) ? str (rec_->group[isa]) : "";
+}
+
+const char* insn::issue (int isa) const
+{
+  return is_isa (isa) ? str (rec_->issue[isa]) : "";
+}
+
+const char* insn::latency (int isa) const
+{
+  return is_isa (isa) ? str (rec_->latency[isa]) : "";
+}
+
+// ----------------------------------------------------------------------------
+
+database::database (const void* data, size_t size)
+: data_ (data), size_ (size)
+{
+  header_ = section<db_header> (0);
+  isa_names_ = section<uint32_t> (header_->isa_names_offset);
+  blocks_ = section<db_block> (header_->blocks_offset);
+  insns_ = section<db_insn> (header_->insns_offset);
+  opcode_words_ = section<uint32_t> (header_->opcode_index_offset);
+  opcode_lists_ = reinterpret_cast<const db_opcode_list*> (opcode_words_ + db_opcode_words);
+  opcode_split_ = reinterpret_cast<const uint32_t*> (opcode_lists_ + header_->opcode_list_count);
+  opcode_entries_ = opcode_split_ + header_->opcode_split_count;
+  mnemonic_index_ = section<db_index_entry> (header_->mnemonic_index_offset);
+  isa_index_ = section<uint32_t> (header_->isa_index_offset);
+  group_index_ = section<db_group_entry> (header_->group_index_offset);
+  strings_ = section<char> (header_->strings_offset);
+}
+
+database::~database (void)
+{
+  munmap (const_cast<void*> (data_), size_);
+}
+
+const char* database::block_title (uint32_t b) const
+{
+  return b < header_->block_count ? str (blocks_[b].title) : "";
+}
+
+int database::find_isa (const char* name) const
+{
+  for (int i = 0; i < db_isa_count; ++i)
+    if (isa_names_[i] != 0 && std::strcmp (str (isa_names_[i]), name) == 0)
+      return i;
+  return -1;
+}
+
+const char* database::isa_name (int isa) const
+{
+  return isa >= 0 && isa < db_isa_count ? str (isa_names_[isa]) : "";
+}
+
+std::vector<insn> database::find_opcode (uint16_t w0, uint16_t w1, int isa,
+					 int fpscr_sz, int fpscr_pr) const
+{
+  std::vector<insn> r;
+
+  for (const uint32_t* n = candidates_begin (w0, w1);
+       n != candidates_end (w0, w1); ++n)
+  {
+    insn i (*this, *n);
+    if (i.matches (w0, w1) && (isa < 0 || i.is_isa (isa))
+	&& i.is_fpscr_mode (fpscr_sz, fpscr_pr))
+      r.push_back (i);
+  }
+  return r;
+}
+
+std::vector<insn> database::find_mnemonic (const char* mnemonic, int isa) const
+{
+  std::vector<insn> r;
+
+  const db_index_entry* begin = mnemonic_index_;
+  const db_index_entry* end = begin + header_->mnemonic_entry_count;
+
+  const db_index_entry* first = std::lower_bound (begin, end, mnemonic,
+    [this] (const db_index_entry& e, const char* m)
+    { return std::strcmp (str (e.key), m) < 0; });
+
+  const db_index_entry* last = std::upper_bound (first, end, mnemonic,
+    [this] (const char* m, const db_index_entry& e)
+    { return std::strcmp (m, str (e.key)) < 0; });
+
+  for (const db_index_entry* e = first; e != last; ++e)
+  {
+    insn i (*this, e->insn);
+    if (isa < 0 || i.is_isa (isa))
+      r.push_back (i);
+  }
+  return r;
+}
+
+std::vector<insn> database::find_isa_insns (int isa) const
+{
+  std::vector<insn> r;
+  if (isa < 0 || isa >= db_isa_count)
+    return r;
+
+  const uint32_t* entries = isa_index_ + db_isa_count + 1;
+  for (uint32_t e = isa_index_[isa]; e < isa_index_[isa + 1]; ++e)
+    r.emplace_back (*this, entries[e]);
+  return r;
+}
+
+std::vector<insn> database::find_group (int isa, const char* group) const
+{
+  std::vector<insn> r;
+
+  const db_group_entry* begin = group_index_;
+  const db_group_entry* end = begin + header_->group_entry_count;
+
+  const db_group_entry* first = std::lower_bound (begin, end, group,
+    [this, isa] (const db_group_entry& e, const char* g)
+    {
+      if (e.isa != (uint32_t)isa)
+	return e.isa < (uint32_t)isa;
+      return std::strcmp (str (e.group), g) < 0;
+    });
+
+  for (const db_group_entry* e = first;
+       e != end && e->isa == (uint32_t)isa && std::strcmp (str (e->group), group) == 0;
+       ++e)
+    r.emplace_back (*this, e->insn);
+
+  return r;
+}
+
+// ----------------------------------------------------------------------------
+
+decoder::decoder (const database& db, int isa, int fpscr_sz, int fpscr_pr)
+: db_ (&db), lists_ (db.header ().opcode_list_count)
+{
+  for (uint32_t l = 0; l < lists_.size (); ++l)
+  {
+    const db_opcode_list& src = db.opcode_lists_[l];
+    lists_[l].first = entries_.size ();
+
+    if (src.count != db_opcode_split)
+      for (uint32_t e = src.first; e < src.first + src.count; ++e)
+      {
+	const insn i (db, db.opcode_entries_[e]);
+	const unsigned int shift = 32 - i.code_size ();
+	if ((i.code_size () == 16 || i.code_size () == 32) && i.is_isa (isa)
+	    && i.is_fpscr_mode (fpscr_sz, fpscr_pr))
+	  entries_.push_back ({ i.code_match () << shift, i.code_mask () << shift,
+				i.number () });
+      }
+
+    lists_[l].count = entries_.size () - lists_[l].first;
+  }
+}
+
+int decoder::decode (uint16_t w0, uint16_t w1) const
+{
+  const uint32_t code = ((uint32_t)w0 << 16) | w1;
+  const db_opcode_list& l = lists_[db_->opcode_list_number (w0, w1)];
+
+  for (const entry* e = entries_.data () + l.first,
+       * end = e + l.count; e != end; ++e)
+    if ((code & e->mask) == e->match)
+      return e->insn;
+  return -1;
+}
+
+// ----------------------------------------------------------------------------
+
+// Checks that the sections are inside of the file and that the index
+// entries refer to existing insns, so that the lookups don't need to.
+static const char* validate (const void* data, size_t size)
+{
+  if (size < sizeof (db_header))
+    return "file too small";
+
+  const db_header& h = *static_cast<const db_header*> (data);
+  if (std::memcmp (h.magic, db_magic, sizeof (h.magic)) != 0)
+    return "not an instruction database";
+  if (h.version != db_version)
+    return "unsupported database version";
+  if (h.file_size != size || h.isa_count != db_isa_count)
+    return "corrupted header";
+
+  auto in_file = [&] (uint32_t offset, uint64_t count, size_t elem_size)
+  {
+    return offset % 4 == 0 && offset + count * elem_size <= size;
+  };
+
+  if (!in_file (h.isa_names_offset, db_isa_count, sizeof (uint32_t))
+      || !in_file (h.blocks_offset, h.block_count, sizeof (db_block))
+      || !in_file (h.insns_offset, h.insn_count, sizeof (db_insn))
+      || !in_file (h.opcode_index_offset,
+		   db_opcode_words + 2 * (uint64_t)h.opcode_list_count
+		   + h.opcode_split_count + h.opcode_entry_count,
+		   sizeof (uint32_t))
+      || !in_file (h.mnemonic_index_offset, h.mnemonic_entry_count,
+		   sizeof (db_index_entry))
+      || !in_file (h.isa_index_offset,
+		   db_isa_count + 1 + (uint64_t)h.isa_entry_count,
+		   sizeof (uint32_t))
+      || !in_file (h.group_index_offset, h.group_entry_count,
+		   sizeof (db_group_entry))
+      || (uint64_t)h.strings_offset + h.strings_size > size
+      || h.strings_size == 0)
+    return "corrupted section table";
+
+  const char* base = static_cast<const char*> (data);
+  const char* strings = base + h.strings_offset;
+  if (strings[0] != '\0' || strings[h.strings_size - 1] != '\0')
+    return "corrupted string pool";
+
+  auto valid_str = [&] (uint32_t ref) { return ref < h.strings_size; };
+  auto valid_buckets = [&] (const uint32_t* b, uint32_t n, uint32_t entries)
+  {
+    for (uint32_t i = 0; i < n; ++i)
+      if (b[i] > b[i + 1])
+	return false;
+    if (b[n] != entries)
+      return false;
+    for (uint32_t i = 0; i < entries; ++i)
+      if (b[n + 1 + i] >= h.insn_count)
+	return false;
+    return true;
+  };
+
+  for (uint32_t i = 0; i < db_isa_count; ++i)
+    if (!valid_str (reinterpret_cast<const uint32_t*> (base + h.isa_names_offset)[i]))
+      return "corrupted isa names";
+
+  const db_block* blocks = reinterpret_cast<const db_block*> (base + h.blocks_offset);
+  for (uint32_t i = 0; i < h.block_count; ++i)
+    if (!valid_str (blocks[i].title))
+      return "corrupted blocks";
+
+  const db_insn* insns = reinterpret_cast<const db_insn*> (base + h.insns_offset);
+  for (uint32_t i = 0; i < h.insn_count; ++i)
+  {
+    const db_insn& r = insns[i];
+    bool ok = r.block < h.block_count
+	      && valid_str (r.format) && valid_str (r.abstract)
+	      && valid_str (r.code) && valid_str (r.t_bit)
+	      && valid_str (r.dc_bit) && valid_str (r.description)
+	      && valid_str (r.note) && valid_str (r.operation)
+	      && valid_str (r.example) && valid_str (r.exceptions);
+    for (int a = 0; a < db_isa_count; ++a)
+      ok = ok && valid_str (r.group[a]) && valid_str (r.issue[a])
+	   && valid_str (r.latency[a]);
+    if (!ok)
+      return "corrupted insns";
+  }
+
+  // Split lists refer to lists that are not split.
+  const uint32_t* words = reinterpret_cast<const uint32_t*> (base + h.opcode_index_offset);
+  const db_opcode_list* lists = reinterpret_cast<const db_opcode_list*> (words + db_opcode_words);
+  const uint32_t* split = reinterpret_cast<const uint32_t*> (lists + h.opcode_list_count);
+  const uint32_t* entries = split + h.opcode_split_count;
+
+  auto valid_list = [&] (uint32_t l, bool allow_split)
+  {
+    if (l >= h.opcode_list_count)
+      return false;
+    if (lists[l].count == db_opcode_split)
+      return allow_split && (uint64_t)lists[l].first + 256 <= h.opcode_split_count;
+    return (uint64_t)lists[l].first + lists[l].count <= h.opcode_entry_count;
+  };
+
+  for (uint32_t i = 0; i < db_opcode_words; ++i)
+    if (!valid_list (words[i], true))
+      return "corrupted opcode index";
+  for (uint32_t i = 0; i < h.opcode_split_count; ++i)
+    if (!valid_list (split[i], false))
+      return "corrupted opcode index";
+  for (uint32_t i = 0; i < h.opcode_entry_count; ++i)
+    if (entries[i] >= h.insn_count)
+      return "corrupted opcode index";
+
+  if (!valid_buckets (reinterpret_cast<const uint32_t*> (base + h.isa_index_offset),
+		      db_isa_count, h.isa_entry_count))
+    return "corrupted isa index";
+
+  const db_index_entry* mn = reinterpret_cast<const db_index_entry*> (
+				base + h.mnemonic_index_offset);
+  for (uint32_t i = 0; i < h.mnemonic_entry_count; ++i)
+    if (!valid_str (mn[i].key) || mn[i].insn >= h.insn_count)
+      return "corrupted mnemonic index";
+
+  const db_group_entry* gr = reinterpret_cast<const db_group_entry*> (
+				base + h.group_index_offset);
+  for (uint32_t i = 0; i < h.group_entry_count; ++i)
+    if (gr[i].isa >= db_isa_count || !valid_str (gr[i].group)
+	|| gr[i].insn >= h.insn_count)
+      return "corrupted group index";
+
+  return nullptr;
+}
+
+std::unique_ptr<database> open (const char* path, std::string* error)
+{
+  auto fail = [error] (const std::string& msg)
+  {
+    if (error != nullptr)
+      *error = msg;
+    return std::unique_ptr<database> ();
+  };
+
+  int fd = ::open (path, O_RDONLY);
+  if (fd < 0)
+    return fail (std::string ("can't open ") + path);
+
+  struct stat st;
+  if (fstat (fd, &st) != 0 || st.st_size <= 0)
+  {
+    close (fd);
+    return fail (std::string ("can't stat ") + path);
+  }
+
+  const size_t size = st.st_size;
+  void* data = mmap (nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+
+  if (data == MAP_FAILED)
+    return fail (std::string ("can't map ") + path);
+
+  if (const char* msg = validate (data, size))
+  {
+    munmap (data, size);
+    return fail (std::string (path) + ": " + msg);
+  }
+
+  return std::unique_ptr<database> (new database (data, size));
+}
+
+} // namespace shdb
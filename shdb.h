@@ -0,0 +1,236 @@
+/*
+shdb - Read-only access to the binary SH instruction database.
+
+This is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this software; see the file LICENSE.  If not see
+<http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SHDB_H
+#define SHDB_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "shdb_format.h"
+
+// The database file written by 'sh_insns --db' is mapped read-only and
+// shared, so processes that open the same file share one copy of it.
+// Nothing is copied or parsed when opening it.  The lookups use the indexes
+// stored in the file.
+//
+//   auto db = shdb::open ("sh_insns.db");
+//   int sh4 = db->find_isa ("SH4");
+//   for (shdb::insn i : db->find_opcode (0x6003, 0, sh4))
+//     std::cout << i.format () << " " << i.latency (sh4) << std::endl;
+//
+// ISAs are referred to by their number in the database.  All the returned
+// strings and insn objects point into the mapped file and are valid as long
+// as the database object exists.
+//
+// An executable model would rather use a decoder, which decodes for one ISA
+// and FPSCR mode:
+//
+//   shdb::decoder sz0 (*db, sh4, 0, 0), sz1 (*db, sh4, 1, 0);
+//   const shdb::decoder* d = &sz0;
+//   ...
+//   int n = d->decode (w0, w1);		// switch 'd' on fschg
+
+namespace shdb
+{
+
+class database;
+
+class insn
+{
+public:
+  insn (const database& db, uint32_t n);
+
+  uint32_t number (void) const { return number_; }
+  const char* block_title (void) const;
+
+  bool is_isa (int isa) const;
+  bool is_privileged (void) const;
+
+  // The FPSCR.SZ / FPSCR.PR mode that selects this insn, or -1 if the insn
+  // doesn't depend on it.
+  int fpscr_sz (void) const;
+  int fpscr_pr (void) const;
+  bool is_fpscr_mode (int sz, int pr) const;
+
+  // The fixed bits of the encoding, see db_insn.
+  unsigned int code_size (void) const { return rec_->code_size; }
+  uint32_t code_match (void) const { return rec_->code_match; }
+  uint32_t code_mask (void) const { return rec_->code_mask; }
+
+  // Returns true if the instruction that starts with the 16 bit words w0 and
+  // w1 is encoded as this insn.  w1 is ignored for 16 bit insns.
+  bool matches (uint16_t w0, uint16_t w1) const;
+
+  const char* format (void) const { return str (rec_->format); }
+  const char* abstract (void) const { return str (rec_->abstract); }
+  const char* code (void) const { return str (rec_->code); }
+  const char* t_bit (void) const { return str (rec_->t_bit); }
+  const char* dc_bit (void) const { return str (rec_->dc_bit); }
+
+  const char* description (void) const { return str (rec_->description); }
+  const char* note (void) const { return str (rec_->note); }
+  const char* operation (void) const { return str (rec_->operation); }
+  const char* example (void) const { return str (rec_->example); }
+  const char* exceptions (void) const { return str (rec_->exceptions); }
+
+  // Empty strings are returned for ISAs that don't have the insn.
+  const char* group (int isa) const;
+  const char* issue (int isa) const;
+  const char* latency (int isa) const;
+
+private:
+  const char* str (uint32_t ref) const;
+
+  const database* db_;
+  const db_insn* rec_;
+  uint32_t number_;
+};
+
+class database
+{
+public:
+  ~database (void);
+
+  database (const database&) = delete;
+  database& operator = (const database&) = delete;
+
+  const db_header& header (void) const { return *header_; }
+
+  size_t insn_count (void) const { return header_->insn_count; }
+  insn get_insn (uint32_t n) const { return insn (*this, n); }
+
+  size_t block_count (void) const { return header_->block_count; }
+  const char* block_title (uint32_t b) const;
+
+  // Returns the ISA number for a name such as "SH4A", or -1.
+  int find_isa (const char* name) const;
+  const char* isa_name (int isa) const;
+
+  // The numbers of the insns of all ISAs and modes whose encoding can start
+  // with the 16 bit words w0 and w1.  This is a lookup in the opcode index.
+  const uint32_t* candidates_begin (uint16_t w0, uint16_t w1) const
+  {
+    return opcode_entries_ + opcode_list (w0, w1).first;
+  }
+  const uint32_t* candidates_end (uint16_t w0, uint16_t w1) const
+  {
+    const db_opcode_list& l = opcode_list (w0, w1);
+    return opcode_entries_ + l.first + l.count;
+  }
+
+  // Passing -1 as 'isa' matches insns of any ISA.  Passing -1 as
+  // 'fpscr_sz' / 'fpscr_pr' matches insns of any FPSCR mode.
+  std::vector<insn> find_opcode (uint16_t w0, uint16_t w1, int isa = -1,
+				 int fpscr_sz = -1, int fpscr_pr = -1) const;
+  std::vector<insn> find_mnemonic (const char* mnemonic, int isa = -1) const;
+  std::vector<insn> find_isa_insns (int isa) const;
+  std::vector<insn> find_group (int isa, const char* group) const;
+
+  // Returns a pointer to the string at offset 'ref' of the string pool.
+  const char* str (uint32_t ref) const { return strings_ + ref; }
+
+  const db_insn& record (uint32_t n) const { return insns_[n]; }
+
+private:
+  friend std::unique_ptr<database> open (const char* path, std::string* error);
+
+  database (const void* data, size_t size);
+
+  template <typename T> const T* section (uint32_t offset) const
+  {
+    return reinterpret_cast<const T*> (static_cast<const char*> (data_) + offset);
+  }
+
+  friend class decoder;
+
+  // The number of the opcode list for the words w0 and w1.
+  uint32_t opcode_list_number (uint16_t w0, uint16_t w1) const
+  {
+    const uint32_t n = opcode_words_[w0];
+    const db_opcode_list& l = opcode_lists_[n];
+    return l.count != db_opcode_split ? n : opcode_split_[l.first + (w1 >> 8)];
+  }
+
+  const db_opcode_list& opcode_list (uint16_t w0, uint16_t w1) const
+  {
+    return opcode_lists_[opcode_list_number (w0, w1)];
+  }
+
+  const void* data_;
+  size_t size_;
+
+  const db_header* header_;
+  const uint32_t* isa_names_;
+  const db_block* blocks_;
+  const db_insn* insns_;
+  const uint32_t* opcode_words_;
+  const db_opcode_list* opcode_lists_;
+  const uint32_t* opcode_split_;
+  const uint32_t* opcode_entries_;
+  const db_index_entry* mnemonic_index_;
+  const uint32_t* isa_index_;
+  const db_group_entry* group_index_;
+  const char* strings_;
+};
+
+// Decode tables for one ISA and FPSCR.SZ / FPSCR.PR mode.  They keep the
+// candidates of each opcode list of the file that belong to the ISA and
+// mode, so the ISA and mode checks are done once when the tables are built.
+// Decoding is the lookup in the opcode index of the file and a compare of
+// the fixed bits of the few remaining candidates.  A model keeps one
+// decoder for each mode it uses and switches between them when the mode
+// changes.  FPSCR.FR only selects the register bank and doesn't affect
+// decoding.
+class decoder
+{
+public:
+  decoder (const database& db, int isa, int fpscr_sz, int fpscr_pr);
+
+  // Returns the number of the insn for the instruction that starts with the
+  // 16 bit words w0 and w1, or -1 if it is not a valid instruction.  The
+  // parts of DSP parallel instructions also match each other's words.  Use
+  // database::find_opcode to get all of them.
+  int decode (uint16_t w0, uint16_t w1) const;
+
+private:
+  // The fixed bits of the code, 16 bit codes in the upper half.
+  struct entry
+  {
+    uint32_t match;
+    uint32_t mask;
+    uint32_t insn;
+  };
+
+  const database* db_;
+  std::vector<db_opcode_list> lists_;	// by opcode list number of the file
+  std::vector<entry> entries_;
+};
+
+// Maps the database file.  Returns a null pointer if the file can't be
+// mapped or is not a valid database, in which case the reason is stored
+// in 'error' if it is not null.
+std::unique_ptr<database> open (const char* path, std::string* error = nullptr);
+
+} // namespace shdb
+
+#endif // SHDB_H
@@ -0,0 +1,183 @@
+/*
+shdb_format - Layout of the binary SH instruction database.
+
+This is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this software; see the file LICENSE.  If not see
+<http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SHDB_FORMAT_H
+#define SHDB_FORMAT_H
+
+#include <cstdint>
+
+// The database is written by 'sh_insns --db <file>'.  It is meant to be
+// mapped into memory and used in place, so all records have a fixed size and
+// all references are plain integers:
+//   - integers are stored in the byte order of the generating host
+//   - section offsets are byte offsets from the start of the file
+//   - strings are NUL-terminated and referenced by their offset into the
+//     string pool.  Offset 0 is the empty string.
+//
+// file layout:
+//   db_header
+//   uint32_t isa_names[db_isa_count]	string refs, indexed by isa
+//   db_block blocks[block_count]
+//   db_insn insns[insn_count]		grouped by block, in page order
+//   opcode index
+//   mnemonic index
+//   isa index
+//   group index
+//   char strings[strings_size]
+//
+// The indexes refer to the insns by their position in the insns array:
+//   - opcode index:
+//       uint32_t opcode_words[65536]	list number for each first word
+//       db_opcode_list lists[opcode_list_count]
+//       uint32_t split[opcode_split_count]	list numbers, 256 per split list
+//       uint32_t entries[opcode_entry_count]	insn numbers
+//     The candidates for an instruction that starts with the words w0, w1
+//     are found with at most two lookups:
+//       l = lists[opcode_words[w0]]
+//       if l.count == db_opcode_split: l = lists[split[l.first + (w1 >> 8)]]
+//       entries[l.first] .. entries[l.first + l.count - 1]
+//     Only lists with more than db_opcode_split_size 32 bit insns are split.
+//     The 16 bit insns of a split list are in all of its parts.
+//   - mnemonic index: db_index_entry sorted by the mnemonic string.
+//   - isa index: uint32_t isa_ranges[db_isa_count + 1] followed by the
+//     uint32_t insn numbers, like the opcode index.
+//   - group index: db_group_entry sorted by isa and group string.
+
+namespace shdb
+{
+
+enum
+{
+  db_version = 4,
+
+  // Number of ISA slots in the records.  Slot 0 is unused (SH_NONE).
+  db_isa_count = 10,
+
+  db_opcode_words = 0x10000,
+  db_opcode_split_size = 8
+};
+
+static const char db_magic[8] = { 'S', 'H', 'I', 'N', 'S', 'D', 'B', '\0' };
+
+struct db_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t file_size;
+
+  uint32_t isa_count;
+  uint32_t isa_names_offset;
+
+  uint32_t block_count;
+  uint32_t blocks_offset;
+
+  uint32_t insn_count;
+  uint32_t insns_offset;
+
+  uint32_t opcode_index_offset;
+  uint32_t opcode_list_count;
+  uint32_t opcode_split_count;
+  uint32_t opcode_entry_count;
+
+  uint32_t mnemonic_index_offset;
+  uint32_t mnemonic_entry_count;
+
+  uint32_t isa_index_offset;
+  uint32_t isa_entry_count;
+
+  uint32_t group_index_offset;
+  uint32_t group_entry_count;
+
+  uint32_t strings_offset;
+  uint32_t strings_size;
+};
+
+struct db_block
+{
+  uint32_t title;
+  uint32_t first_insn;
+  uint32_t insn_count;
+};
+
+enum db_insn_flags
+{
+  db_insn_privileged = 1 << 0,
+
+  // The insn is only decoded in this FPSCR.SZ / FPSCR.PR mode.  If neither
+  // bit of a pair is set the insn doesn't depend on the mode.
+  db_insn_fpscr_sz0 = 1 << 1,
+  db_insn_fpscr_sz1 = 1 << 2,
+  db_insn_fpscr_pr0 = 1 << 3,
+  db_insn_fpscr_pr1 = 1 << 4
+};
+
+struct db_insn
+{
+  uint32_t block;
+  uint32_t isa_mask;		// bit (1 << isa) is set for each supported isa
+  uint32_t flags;		// db_insn_flags
+
+  // The fixed bits of the encoding.  For 32 bit instructions the first
+  // 16 bit word is in the upper half.  code_size is 0 if there is no code.
+  uint32_t code_size;
+  uint32_t code_match;
+  uint32_t code_mask;
+
+  uint32_t format;
+  uint32_t abstract;
+  uint32_t code;
+  uint32_t t_bit;
+  uint32_t dc_bit;
+
+  uint32_t description;
+  uint32_t note;
+  uint32_t operation;
+  uint32_t example;
+  uint32_t exceptions;
+
+  uint32_t group[db_isa_count];
+  uint32_t issue[db_isa_count];
+  uint32_t latency[db_isa_count];
+};
+
+// db_opcode_list::count of a list that is split by the second word.
+static const uint32_t db_opcode_split = 0xFFFFFFFF;
+
+struct db_opcode_list
+{
+  uint32_t first;		// entry, or split table if count is db_opcode_split
+  uint32_t count;
+};
+
+struct db_index_entry
+{
+  uint32_t key;			// string ref
+  uint32_t insn;
+};
+
+struct db_group_entry
+{
+  uint32_t isa;
+  uint32_t group;		// string ref
+  uint32_t insn;
+};
+
+} // namespace shdb
+
+#endif // SHDB_FORMAT_H
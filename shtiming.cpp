@@ -0,0 +1,892 @@
+/*
+shtiming - Trace driven timing estimate from the SH instruction tables.
+
+This is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this software; see the file LICENSE.  If not see
+<http://www.gnu.org/licenses/>.
+
+*/
+
+// Replays a trace written with shtrace through a simple in-order pipeline
+// model built from the issue cycles, latency cycles and groups of the
+// instruction database:
+//
+//   shtiming [-j threads] [-c blocks_per_chunk] sh_insns.db boot.trace SH4 SH4A
+//
+// The trace is split into chunks of blocks, and the chunks of all ISAs are
+// replayed on 'threads' threads (default: number of cores).  Without an ISA
+// argument the ISA of the trace is used.  Besides the timing it reports the
+// most executed insns and the memory footprint of the trace.
+//
+// The model:
+//   - an insn issues when the previous insn's issue cycles have passed and
+//     all its source registers are ready.  The source registers are the
+//     operands of the format that the abstract reads, e.g. Rm and Rn of
+//     "Rn + Rm -> Rn" but only Rm of "(Rm) -> Rn".  The destination
+//     registers are the register writes in the trace.
+//   - a destination register is ready 'latency' cycles after the issue.
+//   - on ISAs with insn groups (SH4, SH4A) two insns with issue cycle 1
+//     issue in the same cycle if the groups allow it (different groups or
+//     both MT, never CO) and the second doesn't depend on the first.
+//   - a branch takes the larger of its issue and latency cycles, which is
+//     where the table puts the branch penalty.  For cycle values like "1/2"
+//     the second value is used for taken branches (the insn after the delay
+//     slot, or the next insn for branches without one, is not the following
+//     one), the first one otherwise.  Other insns always use the first
+//     value.  For ranges like "1-4" the lower value is used.
+// The T bit, caches and memory wait states are not modeled.
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <unordered_set>
+
+#include "shdb.h"
+#include "shtrace.h"
+
+// ----------------------------------------------------------------------------
+
+enum insn_group
+{
+  group_none,
+  group_mt,
+  group_ex,
+  group_br,
+  group_ls,
+  group_fe,
+  group_co
+};
+
+// A register operand of an insn.  The register number is taken from the
+// opcode bits marked with 'field' in the code ('n' or 'm'), or is fixed if
+// field is 0.
+struct operand
+{
+  uint8_t first_reg;	// shtrace::reg_id
+  uint8_t count;	// number of consecutive registers
+  char field;
+  uint8_t scale;	// the field value is multiplied by this
+};
+
+struct insn_timing
+{
+  int issue[2] = { 1, 1 };	// not taken, taken
+  int latency[2] = { 1, 1 };
+  insn_group group = group_none;
+  bool branch = false;
+  bool delayed_branch = false;
+  std::vector<operand> sources;
+
+  // The bit positions of the 'n' and 'm' fields, msb first.
+  std::vector<uint8_t> n_bits, m_bits;
+};
+
+// Returns the not-taken / taken cycles of a value such as "2", "1/2" or
+// "1-4".  Values without numbers count as 1 cycle.
+static void parse_cycles (const char* s, int (&c)[2])
+{
+  std::vector<int> n;
+  bool range = false;
+
+  for (const char* p = s; *p != '\0'; )
+    if (std::isdigit (*p))
+    {
+      n.push_back (std::atoi (p));
+      while (std::isdigit (*p))
+	p++;
+    }
+    else
+      range |= *p++ == '-';
+
+  c[0] = n.empty () ? 1 : n.front ();
+  c[1] = n.empty () || range ? c[0] : n.back ();
+}
+
+static insn_group parse_group (const char* g)
+{
+  static const char* const names[] = { "", "MT", "EX", "BR", "LS", "FE", "CO" };
+  for (int i = 1; i < 7; ++i)
+    if (std::strcmp (g, names[i]) == 0)
+      return (insn_group)i;
+  return group_none;
+}
+
+static std::vector<uint8_t> field_bits (const char* code, char field)
+{
+  std::vector<uint8_t> bits;
+  std::string c;
+  for (const char* p = code; *p != '\0'; ++p)
+    if (!std::isspace (*p))
+      c.push_back (*p);
+
+  for (size_t i = 0; i < c.size (); ++i)
+    if (c[i] == field)
+      bits.push_back ((uint8_t)(c.size () - 1 - i));
+  return bits;
+}
+
+// Returns true if the operand 'word' is read according to the abstract of
+// the insn, i.e. it appears in the abstract other than right after "->".
+// Operands that the abstract doesn't mention count as read.
+static bool is_read (const std::string& abstract, const std::string& word)
+{
+  bool found = false;
+  for (size_t p = abstract.find (word); p != std::string::npos;
+       p = abstract.find (word, p + 1))
+  {
+    const size_t e = p + word.size ();
+    if ((p > 0 && (std::isalnum (abstract[p - 1]) || abstract[p - 1] == '_'))
+	|| (e < abstract.size () && (std::isalnum (abstract[e]) || abstract[e] == '_')))
+      continue;
+
+    found = true;
+    size_t b = p;
+    while (b > 0 && std::isspace (abstract[b - 1]))
+      b--;
+    if (b < 2 || abstract.compare (b - 2, 2, "->") != 0)
+      return true;
+  }
+  return !found;
+}
+
+// Maps the words of the operands in the format that the insn reads to
+// registers.
+static std::vector<operand> parse_sources (const char* format,
+					   const std::string& abstract)
+{
+  using namespace shtrace;
+
+  struct reg_name { const char* name; operand op; };
+  static const reg_name names[] =
+  {
+    { "Rm", { reg_r0, 1, 'm', 1 } }, { "Rn", { reg_r0, 1, 'n', 1 } },
+    { "FRm", { reg_fr0, 1, 'm', 1 } }, { "FRn", { reg_fr0, 1, 'n', 1 } },
+    { "DRm", { reg_fr0, 2, 'm', 2 } }, { "DRn", { reg_fr0, 2, 'n', 2 } },
+    { "XDm", { reg_xf0, 2, 'm', 2 } }, { "XDn", { reg_xf0, 2, 'n', 2 } },
+    { "FVm", { reg_fr0, 4, 'm', 4 } }, { "FVn", { reg_fr0, 4, 'n', 4 } },
+    { "R0", { reg_r0, 1, 0, 1 } }, { "R15", { reg_r0 + 15, 1, 0, 1 } },
+    { "FR0", { reg_fr0, 1, 0, 1 } }, { "XMTRX", { reg_xf0, 16, 0, 1 } },
+    { "SR", { reg_sr, 1, 0, 1 } }, { "GBR", { reg_gbr, 1, 0, 1 } },
+    { "VBR", { reg_vbr, 1, 0, 1 } }, { "SSR", { reg_ssr, 1, 0, 1 } },
+    { "SPC", { reg_spc, 1, 0, 1 } }, { "SGR", { reg_sgr, 1, 0, 1 } },
+    { "DBR", { reg_dbr, 1, 0, 1 } }, { "TBR", { reg_tbr, 1, 0, 1 } },
+    { "MACH", { reg_mach, 1, 0, 1 } }, { "MACL", { reg_macl, 1, 0, 1 } },
+    { "PR", { reg_pr, 1, 0, 1 } }, { "FPSCR", { reg_fpscr, 1, 0, 1 } },
+    { "FPUL", { reg_fpul, 1, 0, 1 } }
+  };
+
+  std::vector<operand> r;
+  const char* p = format;
+  while (*p != '\0' && !std::isspace (*p))
+    p++;
+
+  while (*p != '\0')
+  {
+    if (!std::isalnum (*p) && *p != '_')
+    {
+      p++;
+      continue;
+    }
+
+    const char* e = p;
+    while (std::isalnum (*e) || *e == '_')
+      e++;
+    std::string word (p, e);
+    p = e;
+
+    for (const auto& n : names)
+      if (word == n.name && is_read (abstract, word))
+	r.push_back (n.op);
+  }
+  return r;
+}
+
+static uint32_t field_value (const std::vector<uint8_t>& bits, uint32_t code)
+{
+  uint32_t v = 0;
+  for (uint8_t b : bits)
+    v = (v << 1) | ((code >> b) & 1);
+  return v;
+}
+
+// ----------------------------------------------------------------------------
+
+struct timing_result
+{
+  uint64_t insns = 0;
+  uint64_t cycles = 0;
+  uint64_t dependency_stalls = 0;
+  uint64_t issue_stalls = 0;		// multi-cycle issue
+  uint64_t branch_stalls = 0;		// extra cycles of branches
+  uint64_t dual_issued = 0;
+  uint64_t unknown = 0;
+
+  // Executed insns by insn number.
+  std::vector<uint64_t> insn_counts;
+
+  // Stall cycles by producer and consumer insn number.
+  std::map<std::pair<uint32_t, uint32_t>, uint64_t> stalled_pairs;
+
+  void merge (const timing_result& r);
+};
+
+void timing_result::merge (const timing_result& r)
+{
+  insns += r.insns;
+  cycles += r.cycles;
+  dependency_stalls += r.dependency_stalls;
+  issue_stalls += r.issue_stalls;
+  branch_stalls += r.branch_stalls;
+  dual_issued += r.dual_issued;
+  unknown += r.unknown;
+
+  insn_counts.resize (std::max (insn_counts.size (), r.insn_counts.size ()));
+  for (size_t i = 0; i < r.insn_counts.size (); ++i)
+    insn_counts[i] += r.insn_counts[i];
+
+  for (const auto& p : r.stalled_pairs)
+    stalled_pairs[p.first] += p.second;
+}
+
+// The decode tables and insn timings of one ISA.  They are shared by all
+// threads that replay chunks of the trace for the ISA.
+class timing_tables
+{
+public:
+  timing_tables (const shdb::database& db, int isa);
+
+  const shdb::decoder& decoder (int sz, int pr) const { return *decoders_[sz][pr]; }
+  const insn_timing& timing (uint32_t n) const { return insns_[n]; }
+  size_t insn_count (void) const { return insns_.size (); }
+
+private:
+  std::unique_ptr<shdb::decoder> decoders_[2][2];
+  std::vector<insn_timing> insns_;
+};
+
+timing_tables::timing_tables (const shdb::database& db, int isa)
+: insns_ (db.insn_count ())
+{
+  for (int sz = 0; sz < 2; ++sz)
+    for (int pr = 0; pr < 2; ++pr)
+      decoders_[sz][pr].reset (new shdb::decoder (db, isa, sz, pr));
+
+  for (const shdb::insn& i : db.find_isa_insns (isa))
+  {
+    insn_timing& t = insns_[i.number ()];
+    parse_cycles (i.issue (isa), t.issue);
+    parse_cycles (i.latency (isa), t.latency);
+    t.group = parse_group (i.group (isa));
+    t.sources = parse_sources (i.format (), i.abstract ());
+
+    const std::string m (i.format (), std::strcspn (i.format (), " \t"));
+    static const char* const delayed[] =
+      { "bt/s", "bf/s", "bra", "bsr", "braf", "bsrf", "jmp", "jsr", "rts", "rte" };
+    static const char* const other[] =
+      { "bt", "bf", "jsr/n", "rts/n", "rtv/n" };
+    for (const char* b : delayed)
+      if (m == b)
+	t.branch = t.delayed_branch = true;
+    for (const char* b : other)
+      if (m == b)
+	t.branch = true;
+    t.n_bits = field_bits (i.code (), 'n');
+    t.m_bits = field_bits (i.code (), 'm');
+  }
+}
+
+// Returns the FPSCR value written by the record, or -1.
+static int64_t fpscr_write (const shtrace::record& r)
+{
+  int64_t v = -1;
+  for (const auto& w : r.regs)
+    if (w.reg == shtrace::reg_fpscr)
+      v = w.value;
+  return v;
+}
+
+class timing_model
+{
+public:
+  timing_model (const timing_tables& t) : tables_ (t) { }
+
+  void set_fpscr (uint32_t fpscr)
+  {
+    sz_ = (fpscr >> 20) & 1;
+    pr_ = (fpscr >> 19) & 1;
+  }
+
+  // 'discontinuous' is true if the next insn of the trace doesn't follow
+  // this one.
+  void step (const shtrace::record& r, bool discontinuous, timing_result& res);
+
+  uint64_t cycles (void) const { return next_cycle_; }
+
+private:
+  void finish_branch (const insn_timing& t, uint64_t issue_cycle, bool taken,
+		      timing_result& res);
+
+  const timing_tables& tables_;
+  int sz_ = 0, pr_ = 0;
+
+  uint64_t ready_[shtrace::reg_count] = { };
+  uint32_t writer_[shtrace::reg_count] = { };
+
+  // The number of the step that wrote each register last.
+  uint64_t steps_ = 0;
+  uint64_t written_[shtrace::reg_count] = { };
+
+  uint64_t next_cycle_ = 0;		// earliest issue of the next insn
+  uint64_t last_issue_ = 0;
+  insn_group last_group_ = group_none;
+  bool last_pairable_ = false;
+
+  // A delayed branch waits for its delay slot to see if it is taken.
+  const insn_timing* delayed_branch_ = nullptr;
+  uint64_t delayed_branch_issue_ = 0;
+};
+
+// Charges the cycles of a branch that issued at 'issue_cycle'.
+void timing_model::finish_branch (const insn_timing& t, uint64_t issue_cycle,
+				  bool taken, timing_result& res)
+{
+  const int cost = std::max (t.issue[taken ? 1 : 0], t.latency[taken ? 1 : 0]);
+  if (cost > t.issue[0])
+    res.branch_stalls += cost - t.issue[0];
+
+  next_cycle_ = std::max (next_cycle_, issue_cycle + cost);
+  if (taken)
+    last_pairable_ = false;
+}
+
+void timing_model::step (const shtrace::record& r, bool discontinuous,
+			 timing_result& res)
+{
+  res.insns++;
+  steps_++;
+
+  const insn_timing* delayed_branch = delayed_branch_;
+  delayed_branch_ = nullptr;
+
+  const int n = tables_.decoder (sz_, pr_).decode (r.code[0], r.code[1]);
+  if (n < 0)
+  {
+    // Count unknown opcodes as 1 cycle insns without dependencies.
+    res.unknown++;
+    last_issue_ = next_cycle_;
+    next_cycle_ += 1;
+    last_pairable_ = false;
+  }
+  else
+  {
+    const insn_timing& t = tables_.timing (n);
+    const uint32_t code = r.is_32_bit ? ((uint32_t)r.code[0] << 16) | r.code[1]
+				      : r.code[0];
+    res.insn_counts[n]++;
+
+    // The source register that is ready last, and whether the previous insn
+    // writes a source register.
+    uint64_t dep_ready = 0;
+    int dep_reg = -1;
+    bool reads_last = false;
+    for (const operand& o : t.sources)
+    {
+      uint32_t first = o.first_reg;
+      if (o.field == 'n')
+	first += field_value (t.n_bits, code) * o.scale;
+      else if (o.field == 'm')
+	first += field_value (t.m_bits, code) * o.scale;
+
+      for (uint32_t reg = first; reg < first + o.count && reg < shtrace::reg_count; ++reg)
+      {
+	reads_last |= written_[reg] == steps_ - 1;
+	if (ready_[reg] > dep_ready)
+	{
+	  dep_ready = ready_[reg];
+	  dep_reg = reg;
+	}
+      }
+    }
+
+    const int issue = t.issue[0];
+    const int latency = t.latency[0];
+
+    uint64_t issue_cycle;
+    const bool paired = last_pairable_ && issue == 1 && t.group != group_none
+			&& t.group != group_co && last_group_ != group_co
+			&& (t.group != last_group_ || t.group == group_mt)
+			&& !reads_last && dep_ready <= last_issue_;
+    if (paired)
+    {
+      issue_cycle = last_issue_;
+      res.dual_issued++;
+      last_pairable_ = false;
+    }
+    else
+    {
+      issue_cycle = std::max (next_cycle_, dep_ready);
+      if (dep_ready > next_cycle_)
+      {
+	res.dependency_stalls += dep_ready - next_cycle_;
+	res.stalled_pairs[std::make_pair (writer_[dep_reg], (uint32_t)n)]
+	  += dep_ready - next_cycle_;
+      }
+      last_pairable_ = issue == 1;
+    }
+
+    res.issue_stalls += issue - 1;
+
+    next_cycle_ = std::max (next_cycle_, issue_cycle + issue);
+    last_issue_ = issue_cycle;
+    last_group_ = t.group;
+
+    for (const auto& w : r.regs)
+    {
+      ready_[w.reg] = issue_cycle + latency;
+      writer_[w.reg] = n;
+      written_[w.reg] = steps_;
+    }
+
+    if (t.branch && !t.delayed_branch)
+      finish_branch (t, issue_cycle, discontinuous, res);
+    else if (t.delayed_branch && delayed_branch == nullptr)
+    {
+      delayed_branch_ = &t;
+      delayed_branch_issue_ = issue_cycle;
+    }
+  }
+
+  // This insn is the delay slot.
+  if (delayed_branch != nullptr)
+    finish_branch (*delayed_branch, delayed_branch_issue_, discontinuous, res);
+
+  const int64_t fpscr = fpscr_write (r);
+  if (fpscr >= 0)
+    set_fpscr (fpscr);
+}
+
+// ----------------------------------------------------------------------------
+// The trace is split into chunks of consecutive blocks, which are analyzed
+// in parallel.  First each block is scanned for the memory footprint and
+// its last FPSCR write, which gives the FPSCR mode at the start of each
+// block.  Then each chunk is replayed for each ISA.  The pipeline state at
+// the start of a chunk only depends on the last few insns before it, so
+// the last 'warmup_records' records before the chunk, which may span
+// several blocks, are replayed first without counting them.  This gives
+// the same result as replaying the whole trace in one piece, as long as no
+// latency is longer than that.
+
+enum { warmup_records = 256 };
+
+struct footprint
+{
+  uint64_t reads = 0;
+  uint64_t writes = 0;
+  std::unordered_set<uint32_t> lines;	// 32 byte cache lines
+  std::unordered_set<uint32_t> pages;	// 4 KB pages
+
+  void merge (const footprint& f)
+  {
+    reads += f.reads;
+    writes += f.writes;
+    lines.insert (f.lines.begin (), f.lines.end ());
+    pages.insert (f.pages.begin (), f.pages.end ());
+  }
+};
+
+struct block_scan
+{
+  int64_t last_fpscr = -1;		// the last FPSCR write in the block
+  uint32_t start_fpscr = 0;		// FPSCR at the start of the block
+  footprint mem;
+};
+
+struct chunk
+{
+  size_t first_block;
+  size_t block_count;
+};
+
+// Runs the tasks 0 .. count - 1 on 'threads' threads.  Each idle thread
+// takes the next task, so long tasks don't hold up the others.
+static void run_parallel (size_t count, unsigned int threads,
+			  const std::function<void (size_t)>& task)
+{
+  std::atomic<size_t> next (0);
+  std::vector<std::thread> pool;
+
+  for (unsigned int i = 0; i < std::max (threads, 1u); ++i)
+    pool.emplace_back ([&] (void)
+    {
+      for (size_t t; (t = next.fetch_add (1)) < count; )
+	task (t);
+    });
+
+  for (auto& t : pool)
+    t.join ();
+}
+
+struct trace_file
+{
+  const char* path;
+  std::vector<shtrace::block_info> blocks;
+};
+
+// Reads the blocks in [first, first + count) and calls 'f' with each record
+// and whether the next record is not the following insn.  The first record
+// after the range is read to see that for the last record.
+static std::string replay_blocks (shtrace::reader& trace, const trace_file& tf,
+				  size_t first, size_t count,
+				  const std::function<void (const shtrace::record&, bool)>& f)
+{
+  shtrace::block b;
+  shtrace::record cur, next;
+  bool have_cur = false;
+
+  const size_t end = std::min (first + count + 1, tf.blocks.size ());
+  for (size_t i = first; i < end; ++i)
+  {
+    if (!trace.read_block (tf.blocks[i].offset, b))
+      return trace.error ();
+
+    const bool lookahead = i == first + count;
+    while (b.next (next))
+    {
+      if (have_cur)
+	f (cur, next.pc != cur.pc + (cur.is_32_bit ? 4 : 2));
+      if (lookahead)
+	return std::string ();
+      std::swap (cur, next);
+      have_cur = true;
+    }
+    if (b.corrupted ())
+      return "corrupted record";
+  }
+
+  if (have_cur)
+    f (cur, false);
+  return std::string ();
+}
+
+static block_scan scan_block (shtrace::reader& trace, const trace_file& tf,
+			      size_t i, std::string& error)
+{
+  block_scan s;
+  shtrace::block b;
+  shtrace::record r;
+
+  if (!trace.read_block (tf.blocks[i].offset, b))
+  {
+    error = trace.error ();
+    return s;
+  }
+
+  while (b.next (r))
+  {
+    const int64_t fpscr = fpscr_write (r);
+    if (fpscr >= 0)
+      s.last_fpscr = fpscr;
+
+    for (const auto& m : r.mem)
+    {
+      (m.write ? s.mem.writes : s.mem.reads)++;
+      s.mem.lines.insert (m.addr >> 5);
+      s.mem.pages.insert (m.addr >> 12);
+    }
+  }
+  if (b.corrupted ())
+    error = "corrupted record";
+  return s;
+}
+
+static timing_result replay_chunk (shtrace::reader& trace, const trace_file& tf,
+				   const std::vector<block_scan>& scans,
+				   const timing_tables& tables, const chunk& c,
+				   std::string& error)
+{
+  timing_model model (tables);
+  timing_result res, warmup;
+  res.insn_counts.resize (tables.insn_count ());
+  warmup.insn_counts.resize (tables.insn_count ());
+
+  // The blocks before the chunk that hold the last warmup_records records.
+  size_t first = c.first_block;
+  uint64_t n = 0;
+  while (first > 0 && n < warmup_records)
+    n += tf.blocks[--first].record_count;
+
+  model.set_fpscr (scans[first].start_fpscr);
+  if (first < c.first_block)
+  {
+    uint64_t i = 0;
+    error = replay_blocks (trace, tf, first, c.first_block - first,
+			   [&] (const shtrace::record& r, bool discontinuous)
+    {
+      if (n - i++ <= warmup_records)
+	model.step (r, discontinuous, warmup);
+      else if (fpscr_write (r) >= 0)
+	model.set_fpscr (fpscr_write (r));
+    });
+  }
+
+  const uint64_t start = model.cycles ();
+  if (error.empty ())
+    error = replay_blocks (trace, tf, c.first_block, c.block_count,
+			   [&] (const shtrace::record& r, bool discontinuous)
+			   {
+			     model.step (r, discontinuous, res);
+			   });
+
+  res.cycles = model.cycles () - start;
+  return res;
+}
+
+// ----------------------------------------------------------------------------
+
+static void print_result (const shdb::database& db, const std::string& isa,
+			  const timing_result& r)
+{
+  char line[256];
+  std::snprintf (line, sizeof (line),
+		 "%s: %llu insns, %llu cycles, IPC %.3f\n",
+		 isa.c_str (), (unsigned long long)r.insns,
+		 (unsigned long long)r.cycles,
+		 r.cycles ? (double)r.insns / r.cycles : 0.0);
+  std::cout << line;
+
+  auto print_count = [&] (const char* name, uint64_t n)
+  {
+    std::snprintf (line, sizeof (line), "  %-22s %12llu  %5.1f%%\n", name,
+		   (unsigned long long)n, r.cycles ? 100.0 * n / r.cycles : 0.0);
+    std::cout << line;
+  };
+
+  print_count ("dependency stalls", r.dependency_stalls);
+  print_count ("multi-cycle issue", r.issue_stalls);
+  print_count ("taken branches", r.branch_stalls);
+  print_count ("dual issued insns", r.dual_issued);
+  print_count ("unknown opcodes", r.unknown);
+
+  auto format = [&] (uint32_t n)
+  {
+    std::string f = db.get_insn (n).format ();
+    std::replace (f.begin (), f.end (), '\t', ' ');
+    return f;
+  };
+
+  std::vector<std::pair<uint64_t, uint32_t>> insns;
+  for (size_t i = 0; i < r.insn_counts.size (); ++i)
+    if (r.insn_counts[i] != 0)
+      insns.push_back (std::make_pair (r.insn_counts[i], (uint32_t)i));
+  std::sort (insns.rbegin (), insns.rend ());
+  if (insns.size () > 20)
+    insns.resize (20);
+
+  if (!insns.empty ())
+    std::cout << "  most executed insns:\n";
+  for (const auto& i : insns)
+  {
+    std::snprintf (line, sizeof (line), "  %12llu  %5.1f%%  %s\n",
+		   (unsigned long long)i.first, 100.0 * i.first / r.insns,
+		   format (i.second).c_str ());
+    std::cout << line;
+  }
+
+  std::vector<std::pair<uint64_t, std::pair<uint32_t, uint32_t>>> pairs;
+  for (const auto& p : r.stalled_pairs)
+    pairs.push_back (std::make_pair (p.second, p.first));
+  std::sort (pairs.rbegin (), pairs.rend ());
+  if (pairs.size () > 10)
+    pairs.resize (10);
+
+  if (!pairs.empty ())
+    std::cout << "  hottest stalls (cycles  producer -> consumer):\n";
+  for (const auto& p : pairs)
+  {
+    std::snprintf (line, sizeof (line), "  %12llu  %-24s -> %s\n",
+		   (unsigned long long)p.first, format (p.second.first).c_str (),
+		   format (p.second.second).c_str ());
+    std::cout << line;
+  }
+  std::cout << std::endl;
+}
+
+int main (int argc, char* argv[])
+{
+  unsigned int threads = std::max (std::thread::hardware_concurrency (), 1u);
+  size_t chunk_blocks = 16;
+
+  int argi = 1;
+  for (; argi + 1 < argc && argv[argi][0] == '-'; argi += 2)
+    if (std::strcmp (argv[argi], "-j") == 0 && std::atoi (argv[argi + 1]) > 0)
+      threads = std::atoi (argv[argi + 1]);
+    else if (std::strcmp (argv[argi], "-c") == 0 && std::atoi (argv[argi + 1]) > 0)
+      chunk_blocks = std::atoi (argv[argi + 1]);
+    else
+      break;
+
+  if (argc - argi < 2)
+  {
+    std::cerr << "usage: " << argv[0] << " [-j threads] [-c blocks_per_chunk]"
+		 " database trace [isa...]" << std::endl;
+    return 1;
+  }
+
+  std::string error;
+  std::unique_ptr<shdb::database> db = shdb::open (argv[argi], &error);
+  if (!db)
+  {
+    std::cerr << error << std::endl;
+    return 1;
+  }
+
+  trace_file tf = { argv[argi + 1], { } };
+  std::unique_ptr<shtrace::reader> trace = shtrace::open (tf.path, &error);
+  if (!trace)
+  {
+    std::cerr << error << std::endl;
+    return 1;
+  }
+
+  tf.blocks = trace->scan_blocks ();
+  if (!trace->error ().empty ())
+  {
+    std::cerr << tf.path << ": " << trace->error () << std::endl;
+    return 1;
+  }
+
+  std::vector<std::string> isa_names (argv + argi + 2, argv + argc);
+  if (isa_names.empty ())
+    isa_names.push_back (trace->header ().isa);
+
+  std::vector<std::unique_ptr<timing_tables>> tables;
+  for (const auto& name : isa_names)
+  {
+    const int isa = db->find_isa (name.c_str ());
+    if (isa < 0)
+    {
+      std::cerr << "unknown isa " << name << std::endl;
+      return 1;
+    }
+    tables.emplace_back (new timing_tables (*db, isa));
+  }
+
+  // Each thread uses its own reader.
+  std::mutex readers_mutex;
+  std::vector<std::unique_ptr<shtrace::reader>> readers;
+  std::string task_error;
+
+  auto set_error = [&] (const std::string& e)
+  {
+    std::lock_guard<std::mutex> lock (readers_mutex);
+    if (task_error.empty ())
+      task_error = e;
+  };
+
+  // Returns the reader of the calling thread, or null if the trace can't be
+  // opened again.
+  auto get_reader = [&] (void) -> shtrace::reader*
+  {
+    thread_local shtrace::reader* r = nullptr;
+    if (r == nullptr)
+    {
+      std::string e;
+      std::unique_ptr<shtrace::reader> t = shtrace::open (tf.path, &e);
+      if (!t)
+      {
+	set_error (e);
+	return nullptr;
+      }
+
+      std::lock_guard<std::mutex> lock (readers_mutex);
+      readers.push_back (std::move (t));
+      r = readers.back ().get ();
+    }
+    return r;
+  };
+
+  std::vector<block_scan> scans (tf.blocks.size ());
+  run_parallel (scans.size (), threads, [&] (size_t i)
+  {
+    shtrace::reader* r = get_reader ();
+    if (r == nullptr)
+      return;
+
+    std::string e;
+    scans[i] = scan_block (*r, tf, i, e);
+    if (!e.empty ())
+      set_error (e);
+  });
+
+  uint32_t fpscr = 0;
+  for (auto& s : scans)
+  {
+    s.start_fpscr = fpscr;
+    if (s.last_fpscr >= 0)
+      fpscr = s.last_fpscr;
+  }
+
+  std::vector<chunk> chunks;
+  for (size_t b = 0; b < tf.blocks.size (); b += chunk_blocks)
+    chunks.push_back ({ b, std::min (chunk_blocks, tf.blocks.size () - b) });
+
+  std::vector<timing_result> results (tables.size () * chunks.size ());
+  run_parallel (results.size (), threads, [&] (size_t i)
+  {
+    shtrace::reader* r = get_reader ();
+    if (r == nullptr)
+      return;
+
+    std::string e;
+    results[i] = replay_chunk (*r, tf, scans, *tables[i / chunks.size ()],
+			       chunks[i % chunks.size ()], e);
+    if (!e.empty ())
+      set_error (e);
+  });
+
+  if (!task_error.empty ())
+    std::cerr << tf.path << ": " << task_error << std::endl;
+
+  footprint mem;
+  for (const auto& s : scans)
+    mem.merge (s.mem);
+
+  std::cout << tf.path << ": " << tf.blocks.size () << " blocks, "
+	    << chunks.size () << " chunks\n"
+	    << "  memory reads         " << mem.reads << "\n"
+	    << "  memory writes        " << mem.writes << "\n"
+	    << "  touched cache lines  " << mem.lines.size ()
+	    << " (" << mem.lines.size () * 32 / 1024 << " KB)\n"
+	    << "  touched pages        " << mem.pages.size ()
+	    << " (" << mem.pages.size () * 4 << " KB)\n\n";
+
+  for (size_t i = 0; i < tables.size (); ++i)
+  {
+    timing_result r;
+    for (size_t c = 0; c < chunks.size (); ++c)
+      r.merge (results[i * chunks.size () + c]);
+    print_result (*db, isa_names[i], r);
+  }
+
+  return task_error.empty () ? 0 : 1;
+}
@@ -0,0 +1,518 @@
+/*
+shtrace - Writing and reading binary SH instruction traces.
+
+This is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this software; see the file LICENSE.  If not see
+<http://www.gnu.org/licenses/>.
+
+*/
+
+#include "shtrace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+
+#include <zlib.h>
+
+namespace shtrace
+{
+
+// ----------------------------------------------------------------------------
+
+void record::clear (void)
+{
+  pc = 0;
+  code[0] = code[1] = 0;
+  is_32_bit = false;
+  regs.clear ();
+  mem.clear ();
+}
+
+void codec_state::reset (void)
+{
+  next_pc = 0;
+  addr = 0;
+  std::fill (std::begin (regs), std::end (regs), 0);
+}
+
+static inline uint32_t zigzag (int32_t v)
+{
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag (uint32_t v)
+{
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static inline void put_varint (std::string& o, uint64_t v)
+{
+  while (v >= 0x80)
+  {
+    o.push_back ((char)(v | 0x80));
+    v >>= 7;
+  }
+  o.push_back ((char)v);
+}
+
+static inline void put_u16 (std::string& o, uint16_t v)
+{
+  o.push_back ((char)(v & 0xFF));
+  o.push_back ((char)(v >> 8));
+}
+
+static inline void put_count (std::string& o, size_t n)
+{
+  if (n >= record_count_escape)
+    put_varint (o, (uint32_t)n);
+}
+
+static uint8_t log2_size (uint8_t size)
+{
+  return size >= 8 ? 3 : size >= 4 ? 2 : size >= 2 ? 1 : 0;
+}
+
+static void encode (std::string& o, codec_state& s, const record& r)
+{
+  const bool jump = r.pc != s.next_pc;
+  const size_t mem_count = std::min<size_t> (r.mem.size (), record_count_escape);
+  const size_t reg_count = std::min<size_t> (r.regs.size (), record_count_escape);
+
+  o.push_back ((char)((r.is_32_bit ? record_32_bit : 0)
+		      | (jump ? record_pc_jump : 0)
+		      | (mem_count << record_mem_count_shift)
+		      | (reg_count << record_reg_count_shift)));
+
+  if (jump)
+    put_varint (o, zigzag ((int32_t)(r.pc - s.next_pc)));
+
+  put_u16 (o, r.code[0]);
+  if (r.is_32_bit)
+    put_u16 (o, r.code[1]);
+  s.next_pc = r.pc + (r.is_32_bit ? 4 : 2);
+
+  put_count (o, r.regs.size ());
+  for (const auto& w : r.regs)
+  {
+    o.push_back ((char)w.reg);
+    put_varint (o, zigzag ((int32_t)(w.value - s.regs[w.reg])));
+    s.regs[w.reg] = w.value;
+  }
+
+  put_count (o, r.mem.size ());
+  for (const auto& m : r.mem)
+  {
+    put_varint (o, zigzag ((int32_t)(m.addr - s.addr)));
+    o.push_back ((char)(log2_size (m.size) | (m.write ? mem_write : 0)));
+    put_varint (o, m.value);
+    s.addr = m.addr;
+  }
+}
+
+// ----------------------------------------------------------------------------
+
+writer::writer (std::ofstream&& f, const writer_options& opt)
+: file_ (std::move (f)), opt_ (opt),
+  queue_head_ (0), queue_tail_ (0), closing_ (false), failed_ (false)
+{
+  size_t n = 2;
+  while (n < opt_.queue_blocks)
+    n *= 2;
+  queue_.resize (n);
+
+  state_.reset ();
+  block_.data.reserve (opt_.block_size + 256);
+  thread_ = std::thread (&writer::write_blocks, this);
+}
+
+writer::~writer (void)
+{
+  close ();
+}
+
+void writer::append (const record& r)
+{
+  if (block_.record_count == 0)
+    block_.first_record = record_count_;
+
+  encode (block_.data, state_, r);
+  block_.record_count++;
+  record_count_++;
+
+  if (block_.data.size () >= opt_.block_size)
+    flush_block ();
+}
+
+void writer::flush_block (void)
+{
+  if (block_.record_count == 0)
+    return;
+
+  const size_t tail = queue_tail_.load (std::memory_order_relaxed);
+  while (tail - queue_head_.load (std::memory_order_acquire) == queue_.size ())
+    std::this_thread::yield ();
+
+  std::swap (queue_[tail & (queue_.size () - 1)], block_);
+  queue_tail_.store (tail + 1, std::memory_order_release);
+
+  block_.data.clear ();
+  block_.record_count = 0;
+  state_.reset ();
+}
+
+// Runs on the background thread.
+void writer::write_blocks (void)
+{
+  pending_block b;
+  std::string compressed;
+
+  for (;;)
+  {
+    const size_t head = queue_head_.load (std::memory_order_relaxed);
+    if (head == queue_tail_.load (std::memory_order_acquire))
+    {
+      if (closing_.load (std::memory_order_acquire)
+	  && head == queue_tail_.load (std::memory_order_acquire))
+	break;
+      std::this_thread::sleep_for (std::chrono::microseconds (100));
+      continue;
+    }
+
+    std::swap (b, queue_[head & (queue_.size () - 1)]);
+    queue_head_.store (head + 1, std::memory_order_release);
+
+    block_header h;
+    h.magic = block_magic;
+    h.method = block_raw;
+    h.data_size = (uint32_t)b.data.size ();
+    max_data_size_ = std::max (max_data_size_, h.data_size);
+    h.record_count = b.record_count;
+    h.reserved = 0;
+    h.first_record = b.first_record;
+
+    const std::string* stored = &b.data;
+    if (opt_.compression > 0)
+    {
+      uLongf size = compressBound (b.data.size ());
+      compressed.resize (size);
+      if (compress2 ((Bytef*)&compressed[0], &size, (const Bytef*)b.data.data (),
+		     b.data.size (), opt_.compression) == Z_OK
+	  && size < b.data.size ())
+      {
+	compressed.resize (size);
+	stored = &compressed;
+	h.method = block_deflate;
+      }
+    }
+    h.stored_size = (uint32_t)stored->size ();
+
+    file_.write ((const char*)&h, sizeof (h));
+    file_.write (stored->data (), stored->size ());
+    if (!file_.good ())
+      failed_.store (true);
+  }
+}
+
+bool writer::close (std::string* error)
+{
+  if (!closed_)
+  {
+    closed_ = true;
+    flush_block ();
+    closing_.store (true, std::memory_order_release);
+    thread_.join ();
+
+    file_.seekp (offsetof (trace_header, max_data_size));
+    file_.write ((const char*)&max_data_size_, sizeof (max_data_size_));
+    file_.flush ();
+    if (!file_.good ())
+      failed_.store (true);
+    file_.close ();
+  }
+
+  if (failed_.load () && error != nullptr)
+    *error = "failed to write the trace";
+  return !failed_.load ();
+}
+
+std::unique_ptr<writer> create (const char* path, const char* isa,
+				const writer_options& opt, std::string* error)
+{
+  std::ofstream f (path, std::ios::out | std::ios::binary | std::ios::trunc);
+
+  trace_header h;
+  std::memset (&h, 0, sizeof (h));
+  std::memcpy (h.magic, trace_magic, sizeof (h.magic));
+  h.version = trace_version;
+  h.header_size = sizeof (h);
+  std::strncpy (h.isa, isa, sizeof (h.isa) - 1);
+
+  f.write ((const char*)&h, sizeof (h));
+  if (!f.good ())
+  {
+    if (error != nullptr)
+      *error = std::string ("can't create ") + path;
+    return std::unique_ptr<writer> ();
+  }
+
+  return std::unique_ptr<writer> (new writer (std::move (f), opt));
+}
+
+// ----------------------------------------------------------------------------
+
+void block::reset (uint64_t first_record, uint32_t record_count)
+{
+  pos_ = 0;
+  first_record_ = first_record;
+  record_count_ = record_count;
+  decoded_ = 0;
+  corrupted_ = false;
+  state_.reset ();
+}
+
+bool block::next (record& r)
+{
+  if (decoded_ == record_count_ || corrupted_)
+    return false;
+
+  const uint8_t* p = (const uint8_t*)data_.data () + pos_;
+  const uint8_t* end = (const uint8_t*)data_.data () + data_.size ();
+  bool ok = true;
+
+  auto get_u8 = [&] (void) -> uint8_t
+  {
+    if (p == end)
+    {
+      ok = false;
+      return 0;
+    }
+    return *p++;
+  };
+
+  auto get_varint64 = [&] (void)
+  {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 70; shift += 7)
+    {
+      uint8_t b = get_u8 ();
+      v |= (uint64_t)(b & 0x7F) << shift;
+      if ((b & 0x80) == 0)
+	break;
+    }
+    return v;
+  };
+
+  auto get_varint = [&] (void) { return (uint32_t)get_varint64 (); };
+
+  auto get_u16 = [&] (void)
+  {
+    uint16_t lo = get_u8 ();
+    return (uint16_t)(lo | (get_u8 () << 8));
+  };
+
+  auto get_count = [&] (uint32_t n)
+  {
+    return n == record_count_escape ? get_varint () : n;
+  };
+
+  const uint8_t flags = get_u8 ();
+
+  r.is_32_bit = (flags & record_32_bit) != 0;
+  r.pc = state_.next_pc;
+  if (flags & record_pc_jump)
+    r.pc += unzigzag (get_varint ());
+
+  r.code[0] = get_u16 ();
+  r.code[1] = r.is_32_bit ? get_u16 () : 0;
+  state_.next_pc = r.pc + (r.is_32_bit ? 4 : 2);
+
+  const uint32_t reg_count = get_count ((flags >> record_reg_count_shift) & 7);
+  r.regs.resize (ok ? std::min<uint32_t> (reg_count, data_.size ()) : 0);
+  for (auto& w : r.regs)
+  {
+    w.reg = get_u8 ();
+    w.value = state_.regs[w.reg] + unzigzag (get_varint ());
+    state_.regs[w.reg] = w.value;
+  }
+
+  const uint32_t mem_count = get_count ((flags >> record_mem_count_shift) & 7);
+  r.mem.resize (ok ? std::min<uint32_t> (mem_count, data_.size ()) : 0);
+  for (auto& m : r.mem)
+  {
+    m.addr = state_.addr + unzigzag (get_varint ());
+    const uint8_t f = get_u8 ();
+    m.size = 1 << (f & mem_size_mask);
+    m.write = (f & mem_write) != 0;
+    m.value = get_varint64 ();
+    state_.addr = m.addr;
+  }
+
+  if (!ok)
+  {
+    corrupted_ = true;
+    return false;
+  }
+
+  pos_ = p - (const uint8_t*)data_.data ();
+  decoded_++;
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+
+reader::reader (std::ifstream&& f, const trace_header& h)
+: file_ (std::move (f)), header_ (h),
+  max_data_size_ (h.max_data_size != 0 ? h.max_data_size
+		  : (uint32_t)default_max_data_size)
+{
+}
+
+bool reader::fail (const std::string& msg)
+{
+  if (error_.empty ())
+    error_ = msg;
+  return false;
+}
+
+bool reader::read_next_block (block& b)
+{
+  block_header h;
+  file_.read ((char*)&h, sizeof (h));
+  if (file_.gcount () == 0 && file_.eof ())
+    return false;
+  if (file_.gcount () != sizeof (h) || h.magic != block_magic
+      || (h.method != block_raw && h.method != block_deflate))
+    return fail ("corrupted block header");
+
+  // Don't trust the sizes before they are checked against the maximum.
+  const uLong max_stored = h.method == block_raw ? max_data_size_
+			   : compressBound (max_data_size_);
+  if (h.data_size > max_data_size_ || h.stored_size > max_stored)
+    return fail ("corrupted block header");
+
+  std::string& dst = h.method == block_raw ? b.data_ : stored_;
+  dst.resize (h.stored_size);
+  file_.read (&dst[0], h.stored_size);
+  if ((uint32_t)file_.gcount () != h.stored_size)
+    return fail ("truncated block");
+
+  if (h.method == block_deflate)
+  {
+    b.data_.resize (h.data_size);
+    uLongf size = h.data_size;
+    if (uncompress ((Bytef*)&b.data_[0], &size, (const Bytef*)stored_.data (),
+		    stored_.size ()) != Z_OK
+	|| size != h.data_size)
+      return fail ("corrupted block data");
+  }
+  else if (h.stored_size != h.data_size)
+    return fail ("corrupted block header");
+
+  b.reset (h.first_record, h.record_count);
+  return true;
+}
+
+bool reader::next (record& r)
+{
+  while (!current_.next (r))
+  {
+    if (current_.corrupted ())
+      return fail ("corrupted record");
+    if (!read_next_block (current_))
+      return false;
+  }
+  return true;
+}
+
+std::vector<block_info> reader::scan_blocks (void)
+{
+  std::vector<block_info> r;
+
+  file_.clear ();
+  file_.seekg (header_.header_size);
+
+  for (;;)
+  {
+    block_header h;
+    const uint64_t offset = file_.tellg ();
+    file_.read ((char*)&h, sizeof (h));
+    if (file_.gcount () == 0)
+      break;
+    if (file_.gcount () != sizeof (h) || h.magic != block_magic)
+    {
+      fail ("corrupted block header");
+      break;
+    }
+
+    r.push_back ({ offset, h.first_record, h.record_count });
+    file_.seekg (h.stored_size, std::ios::cur);
+  }
+
+  // Continue streaming from the start.
+  file_.clear ();
+  file_.seekg (header_.header_size);
+  current_.reset (0, 0);
+  return r;
+}
+
+bool reader::read_block (uint64_t offset, block& b)
+{
+  file_.clear ();
+  file_.seekg (offset);
+  return read_next_block (b) || fail ("can't read block");
+}
+
+std::unique_ptr<reader> open (const char* path, std::string* error)
+{
+  auto fail = [error] (const std::string& msg)
+  {
+    if (error != nullptr)
+      *error = msg;
+    return std::unique_ptr<reader> ();
+  };
+
+  std::ifstream f (path, std::ios::in | std::ios::binary);
+  if (!f.good ())
+    return fail (std::string ("can't open ") + path);
+
+  // The headers before version 3 end after the ISA.
+  const size_t v1_header_size = offsetof (trace_header, max_data_size);
+
+  trace_header h;
+  std::memset (&h, 0, sizeof (h));
+  f.read ((char*)&h, v1_header_size);
+  if (f.gcount () != (std::streamsize)v1_header_size
+      || std::memcmp (h.magic, trace_magic, sizeof (h.magic)) != 0)
+    return fail (std::string (path) + ": not an instruction trace");
+  // Version 1 and 2 traces are read like version 3 traces without a
+  // maximum block size.
+  if (h.version < 1 || h.version > trace_version
+      || h.header_size < (h.version < 3 ? v1_header_size : sizeof (h)))
+    return fail (std::string (path) + ": unsupported trace version");
+
+  if (h.version >= 3)
+  {
+    f.read ((char*)&h + v1_header_size, sizeof (h) - v1_header_size);
+    if (f.gcount () != (std::streamsize)(sizeof (h) - v1_header_size))
+      return fail (std::string (path) + ": not an instruction trace");
+  }
+
+  h.isa[sizeof (h.isa) - 1] = '\0';
+  f.seekg (h.header_size);
+
+  return std::unique_ptr<reader> (new reader (std::move (f), h));
+}
+
+} // namespace shtrace
@@ -0,0 +1,294 @@
+/*
+shtrace - Writing and reading binary SH instruction traces.
+
+This is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this software; see the file LICENSE.  If not see
+<http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SHTRACE_H
+#define SHTRACE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shtrace_format.h"
+
+// A trace is a sequence of records, one for each executed instruction, with
+// the registers and memory it wrote or read.  A simulator records it with a
+// writer:
+//
+//   auto w = shtrace::create ("boot.trace", "SH4");
+//   shtrace::record r;
+//   ...
+//   r.clear ();
+//   r.pc = pc;
+//   r.code[0] = w0;
+//   r.regs.push_back ({ uint8_t (shtrace::reg_r0 + n), value });
+//   w->append (r);
+//   ...
+//   w->close ();
+//
+// append only encodes the record into the current block.  Full blocks are
+// passed to a background thread, which compresses and writes them.
+//
+// A reader streams the records back, or reads single blocks for processing
+// them in parallel:
+//
+//   auto t = shtrace::open ("boot.trace");
+//   while (t->next (r))
+//     ...
+
+namespace shtrace
+{
+
+// Register numbers for reg_write::reg.
+enum reg_id
+{
+  reg_r0 = 0,			// R0 - R15
+  reg_sr = 16,
+  reg_gbr,
+  reg_vbr,
+  reg_ssr,
+  reg_spc,
+  reg_sgr,
+  reg_dbr,
+  reg_tbr,
+  reg_mach,
+  reg_macl,
+  reg_pr,
+  reg_fpscr,
+  reg_fpul,
+  reg_fr0 = 32,			// FR0 - FR15
+  reg_xf0 = 48,			// XF0 - XF15
+  reg_bank_r0 = 64,		// R0_BANK - R7_BANK
+  reg_a0 = 72,			// DSP registers
+  reg_a1,
+  reg_a0g,
+  reg_a1g,
+  reg_m0,
+  reg_m1,
+  reg_x0,
+  reg_x1,
+  reg_y0,
+  reg_y1,
+  reg_mod,
+  reg_rs,
+  reg_re,
+  reg_dsr,
+
+  reg_count = 256
+};
+
+struct reg_write
+{
+  uint8_t reg;
+  uint32_t value;
+};
+
+struct mem_access
+{
+  uint32_t addr;
+  uint64_t value;		// 64 bit for 8 byte fmov accesses
+  uint8_t size;			// 1, 2, 4 or 8
+  bool write;
+};
+
+struct record
+{
+  uint32_t pc = 0;
+  uint16_t code[2] = { };
+  bool is_32_bit = false;
+
+  std::vector<reg_write> regs;
+  std::vector<mem_access> mem;
+
+  // Keeps the capacity of the vectors.
+  void clear (void);
+};
+
+// The state that the deltas of the records in a block refer to.
+struct codec_state
+{
+  uint32_t next_pc;
+  uint32_t addr;
+  uint32_t regs[reg_count];
+
+  void reset (void);
+};
+
+// ----------------------------------------------------------------------------
+
+struct writer_options
+{
+  // Blocks are closed after this many bytes of encoded records.
+  size_t block_size = 256 * 1024;
+
+  // Number of blocks that can wait for the background thread.  append
+  // waits if the queue is full.
+  size_t queue_blocks = 16;
+
+  // zlib compression level, 0 stores the blocks uncompressed.
+  int compression = 1;
+};
+
+class writer
+{
+public:
+  ~writer (void);
+
+  writer (const writer&) = delete;
+  writer& operator = (const writer&) = delete;
+
+  void append (const record& r);
+
+  // Writes the last block, waits for the background thread and fills in
+  // the largest block size in the header.  Returns false if writing any
+  // block failed.
+  bool close (std::string* error = nullptr);
+
+  uint64_t record_count (void) const { return record_count_; }
+
+private:
+  friend std::unique_ptr<writer> create (const char* path, const char* isa,
+					 const writer_options& opt,
+					 std::string* error);
+
+  struct pending_block
+  {
+    std::string data;
+    uint64_t first_record = 0;
+    uint32_t record_count = 0;
+  };
+
+  writer (std::ofstream&& f, const writer_options& opt);
+
+  void flush_block (void);
+  void write_blocks (void);
+
+  std::ofstream file_;
+  writer_options opt_;
+
+  // The block that is being encoded.
+  pending_block block_;
+  codec_state state_;
+  uint64_t record_count_ = 0;
+
+  // Single producer / single consumer ring of full blocks.  The slots are
+  // swapped in and out, so their buffers are reused.
+  std::vector<pending_block> queue_;
+  std::atomic<size_t> queue_head_;	// next slot to write to the file
+  std::atomic<size_t> queue_tail_;	// next slot to fill
+  std::atomic<bool> closing_;
+  std::atomic<bool> failed_;
+
+  // Only used by the background thread until it is joined.
+  uint32_t max_data_size_ = 0;
+
+  std::thread thread_;
+  bool closed_ = false;
+};
+
+std::unique_ptr<writer> create (const char* path, const char* isa,
+				const writer_options& opt = writer_options (),
+				std::string* error = nullptr);
+
+// ----------------------------------------------------------------------------
+
+struct block_info
+{
+  uint64_t offset;		// of the block_header in the file
+  uint64_t first_record;
+  uint32_t record_count;
+};
+
+// One decompressed block.
+class block
+{
+public:
+  uint64_t first_record (void) const { return first_record_; }
+  uint32_t record_count (void) const { return record_count_; }
+
+  // Decodes the next record of the block.  Returns false at the end of the
+  // block or if the data is corrupted.
+  bool next (record& r);
+
+  bool corrupted (void) const { return corrupted_; }
+
+private:
+  friend class reader;
+
+  void reset (uint64_t first_record, uint32_t record_count);
+
+  std::string data_;
+  size_t pos_ = 0;
+  uint64_t first_record_ = 0;
+  uint32_t record_count_ = 0;
+  uint32_t decoded_ = 0;
+  bool corrupted_ = false;
+  codec_state state_;
+};
+
+class reader
+{
+public:
+  reader (const reader&) = delete;
+  reader& operator = (const reader&) = delete;
+
+  const trace_header& header (void) const { return header_; }
+
+  // Streams the records of the whole trace.  Returns false at the end of
+  // the trace or on an error.
+  bool next (record& r);
+
+  // Reads only the block headers.
+  std::vector<block_info> scan_blocks (void);
+
+  // Reads the block at 'offset'.  Each thread that reads blocks in parallel
+  // uses its own reader.
+  bool read_block (uint64_t offset, block& b);
+
+  // Empty unless reading failed.
+  const std::string& error (void) const { return error_; }
+
+private:
+  friend std::unique_ptr<reader> open (const char* path, std::string* error);
+
+  reader (std::ifstream&& f, const trace_header& h);
+
+  bool read_next_block (block& b);
+  bool fail (const std::string& msg);
+
+  std::ifstream file_;
+  trace_header header_;
+  uint32_t max_data_size_;
+  block current_;
+  std::string stored_;
+  std::string error_;
+};
+
+// Opens a trace file.  Returns a null pointer if the file can't be opened
+// or is not a trace, in which case the reason is stored in 'error' if it is
+// not null.
+std::unique_ptr<reader> open (const char* path, std::string* error = nullptr);
+
+} // namespace shtrace
+
+#endif // SHTRACE_H
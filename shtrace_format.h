@@ -0,0 +1,122 @@
+/*
+shtrace_format - Layout of the binary SH instruction trace.
+
+This is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this software; see the file LICENSE.  If not see
+<http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef SHTRACE_FORMAT_H
+#define SHTRACE_FORMAT_H
+
+#include <cstdint>
+
+// A trace is written and read sequentially, so unlike the instruction
+// database it is a stream of blocks rather than a mappable image:
+//   trace_header
+//   block_header, block data
+//   block_header, block data
+//   ...
+//
+// Integers in the headers are stored in the byte order of the writing host.
+// Each block is encoded on its own, so the blocks can be decoded in any
+// order and in parallel.  The block data is deflate compressed if the
+// block's method is block_deflate.  The uncompressed data is a sequence of
+// records:
+//   uint8_t flags			record_flags
+//   varint pc_delta			only with record_pc_jump
+//   uint16_t code[1 or 2]		little endian
+//   varint reg_count			only if the count in the flags is 7
+//   reg_count * { uint8_t reg, varint value_delta }
+//   varint mem_count			only if the count in the flags is 7
+//   mem_count * { varint addr_delta, uint8_t mem_flags, varint value }
+//
+// The memory value is up to 64 bits for 8 byte accesses, all other varints
+// are up to 32 bits.  Version 1 only had 32 bit memory values.
+//
+// The trace header records the largest data size of the blocks, which the
+// writer fills in when it is closed.  Readers reject blocks that claim to be
+// larger before allocating anything for them.  Traces before version 3, or
+// whose writer wasn't closed, have no maximum and are limited to
+// default_max_data_size.
+//
+// varints are LEB128 encoded, the deltas are zigzag encoded signed values:
+//   - pc_delta is relative to the address after the previous insn.  Without
+//     record_pc_jump the insn follows the previous one.  The first record of
+//     a block always has a pc_delta, relative to 0.
+//   - value_delta is relative to the previous value of the same register in
+//     the block, or to 0.
+//   - addr_delta is relative to the previous memory address in the block, or
+//     to 0.
+
+namespace shtrace
+{
+
+enum
+{
+  trace_version = 3,
+
+  default_max_data_size = 64 << 20,
+
+  block_magic = 0x4B4C4253,	// "SBLK"
+  block_raw = 0,
+  block_deflate = 1
+};
+
+static const char trace_magic[8] = { 'S', 'H', 'T', 'R', 'A', 'C', 'E', '\0' };
+
+struct trace_header
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;		// sizeof (trace_header)
+
+  // The ISA of the traced code as in the instruction database, e.g. "SH4".
+  char isa[16];
+
+  // Since version 3.  The largest block_header::data_size, or 0 if unknown.
+  uint32_t max_data_size;
+  uint32_t reserved;
+};
+
+struct block_header
+{
+  uint32_t magic;
+  uint32_t method;
+  uint32_t stored_size;		// size of the block data in the file
+  uint32_t data_size;		// size of the block data after decompressing
+  uint32_t record_count;
+  uint32_t reserved;
+  uint64_t first_record;	// index of the first record in the trace
+};
+
+enum record_flags
+{
+  record_32_bit = 1 << 0,
+  record_pc_jump = 1 << 1,
+
+  record_mem_count_shift = 2,	// 3 bits
+  record_reg_count_shift = 5,	// 3 bits
+  record_count_escape = 7
+};
+
+enum mem_flags
+{
+  mem_size_mask = 3,		// log2 of the access size
+  mem_write = 1 << 2
+};
+
+} // namespace shtrace
+
+#endif // SHTRACE_FORMAT_H
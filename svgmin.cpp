@@ -0,0 +1,583 @@
+/*
+svgmin - a simple optimizer for the Inkscape exported SVG diagrams.
+
+This is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3, or (at your option)
+any later version.
+
+This software is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this software; see the file LICENSE.  If not see
+<http://www.gnu.org/licenses/>.
+
+*/
+
+// Reads an SVG file from stdin and writes a minimized version to stdout.
+// This is not a general purpose SVG optimizer.  It handles the plain SVG
+// files that Inkscape produces from the .odg diagrams:
+//   - comments, processing instructions and <metadata> are removed
+//   - inkscape:* / sodipodi:* elements and attributes are removed
+//   - unreferenced ids are removed, referenced ids are renamed to short,
+//     prefixed ids (so that multiple diagrams can be inlined into one page)
+//   - attribute-less groups are dissolved
+//   - adjacent stroke-only paths with equal attributes are merged
+//   - numbers are rounded to a fixed number of decimals
+//
+// usage: svgmin [-p decimals] [-n id_prefix] < in.svg > out.svg
+
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <utility>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+
+// ----------------------------------------------------------------------------
+
+struct node
+{
+  // text nodes have an empty name.
+  std::string name;
+  std::string text;
+  std::vector<std::pair<std::string, std::string>> attrs;
+  std::vector<node> children;
+
+  bool is_text (void) const { return name.empty (); }
+
+  std::string* attr (const char* n)
+  {
+    for (auto& a : attrs)
+      if (a.first == n)
+	return &a.second;
+    return nullptr;
+  }
+
+  void erase_attr (const char* n)
+  {
+    for (auto i = attrs.begin (); i != attrs.end (); ++i)
+      if (i->first == n)
+      {
+	attrs.erase (i);
+	return;
+      }
+  }
+};
+
+static bool has_prefix (const std::string& s, const char* p)
+{
+  return s.compare (0, std::strlen (p), p) == 0;
+}
+
+// ----------------------------------------------------------------------------
+// parsing
+
+static void skip_past (const std::string& s, size_t& pos, const char* what)
+{
+  size_t p = s.find (what, pos);
+  pos = p == std::string::npos ? s.size () : p + std::strlen (what);
+}
+
+static void skip_spaces (const std::string& s, size_t& pos)
+{
+  while (pos < s.size () && std::isspace ((unsigned char)s[pos]))
+    pos++;
+}
+
+static bool is_name_char (char c)
+{
+  return !std::isspace ((unsigned char)c) && c != '=' && c != '/' && c != '>';
+}
+
+static void parse_children (const std::string& s, size_t& pos, node& parent);
+
+static void parse_element (const std::string& s, size_t& pos, node& parent)
+{
+  parent.children.emplace_back ();
+  node& n = parent.children.back ();
+
+  pos++;  // '<'
+  while (pos < s.size () && is_name_char (s[pos]))
+    n.name += s[pos++];
+
+  while (true)
+  {
+    skip_spaces (s, pos);
+    if (pos >= s.size ())
+      return;
+
+    if (s[pos] == '/')
+    {
+      skip_past (s, pos, ">");
+      return;
+    }
+    if (s[pos] == '>')
+    {
+      pos++;
+      parse_children (s, pos, n);
+      return;
+    }
+
+    std::string aname;
+    while (pos < s.size () && is_name_char (s[pos]))
+      aname += s[pos++];
+
+    skip_spaces (s, pos);
+    if (pos >= s.size () || s[pos] != '=')
+      continue;
+    pos++;
+    skip_spaces (s, pos);
+
+    const char q = s[pos++];
+    size_t end = s.find (q, pos);
+    if (end == std::string::npos)
+      end = s.size ();
+    n.attrs.emplace_back (aname, s.substr (pos, end - pos));
+    pos = end + 1;
+  }
+}
+
+static void parse_children (const std::string& s, size_t& pos, node& parent)
+{
+  while (pos < s.size ())
+  {
+    if (s.compare (pos, 4, "<!--") == 0)
+      skip_past (s, pos, "-->");
+    else if (s.compare (pos, 2, "<?") == 0 || s.compare (pos, 2, "<!") == 0)
+      skip_past (s, pos, ">");
+    else if (s.compare (pos, 2, "</") == 0)
+    {
+      skip_past (s, pos, ">");
+      return;
+    }
+    else if (s[pos] == '<')
+      parse_element (s, pos, parent);
+    else
+    {
+      size_t end = s.find ('<', pos);
+      if (end == std::string::npos)
+	end = s.size ();
+      parent.children.emplace_back ();
+      parent.children.back ().text = s.substr (pos, end - pos);
+      pos = end;
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+// number shortening
+
+static int decimals = 2;
+
+static void append_number (std::string& out, double v, int prec)
+{
+  char buf[64];
+  std::snprintf (buf, sizeof (buf), "%.*f", prec, v);
+  std::string s = buf;
+
+  if (s.find ('.') != std::string::npos)
+  {
+    while (s.back () == '0')
+      s.pop_back ();
+    if (s.back () == '.')
+      s.pop_back ();
+  }
+
+  if (s == "-0")
+    s = "0";
+  else if (has_prefix (s, "0."))
+    s.erase (0, 1);
+  else if (has_prefix (s, "-0."))
+    s.erase (1, 1);
+
+  out += s;
+}
+
+// Rewrites all numbers in 's' with 'prec' decimals.  Identifiers, hex colors
+// and url references are copied as they are.
+static std::string shorten_numbers (const std::string& s, int prec)
+{
+  std::string r;
+  r.reserve (s.size ());
+
+  for (size_t i = 0; i < s.size (); )
+  {
+    const char c = s[i];
+    const char n = i + 1 < s.size () ? s[i + 1] : '\0';
+
+    if (std::isalpha ((unsigned char)c) || c == '#' || c == '_'
+	|| (c == '-' && std::isalpha ((unsigned char)n)))
+    {
+      while (i < s.size () && (std::isalnum ((unsigned char)s[i])
+			       || s[i] == '#' || s[i] == '_' || s[i] == '-'))
+	r += s[i++];
+    }
+    else if (std::isdigit ((unsigned char)c) || c == '.'
+	     || ((c == '-' || c == '+')
+		 && (std::isdigit ((unsigned char)n) || n == '.')))
+    {
+      char* end;
+      const double v = std::strtod (s.c_str () + i, &end);
+      if (end == s.c_str () + i)
+	r += s[i++];
+      else
+      {
+	append_number (r, v, prec);
+	i = end - s.c_str ();
+      }
+    }
+    else
+      r += s[i++];
+  }
+
+  return r;
+}
+
+// Properties that are set to their initial values.  Inkscape puts the
+// complete style on each element, so nothing is inherited from the groups.
+// The font properties are kept because an inlined SVG would inherit them
+// from the page.
+static const char* const default_style_props[] =
+{
+  "fill-opacity:1", "fill-rule:nonzero", "stroke-opacity:1",
+  "stroke-dasharray:none", "stroke-linecap:butt", "stroke-linejoin:miter",
+  "writing-mode:lr-tb", "opacity:1"
+};
+
+static bool is_default_style_prop (const std::string& p)
+{
+  for (const char* d : default_style_props)
+    if (p == d)
+      return true;
+  return false;
+}
+
+static std::string clean_style (const std::string& s)
+{
+  std::string r;
+  size_t pos = 0;
+
+  while (pos < s.size ())
+  {
+    size_t end = s.find (';', pos);
+    if (end == std::string::npos)
+      end = s.size ();
+
+    std::string prop = s.substr (pos, end - pos);
+    if (!prop.empty () && !has_prefix (prop, "-inkscape")
+	&& !is_default_style_prop (prop))
+    {
+      if (!r.empty ())
+	r += ';';
+      r += prop;
+    }
+    pos = end + 1;
+  }
+
+  return shorten_numbers (r, decimals);
+}
+
+// ----------------------------------------------------------------------------
+// tree transformations
+
+static bool is_editor_name (const std::string& n)
+{
+  return has_prefix (n, "inkscape:") || has_prefix (n, "sodipodi:")
+	 || has_prefix (n, "rdf:") || has_prefix (n, "cc:")
+	 || has_prefix (n, "dc:");
+}
+
+static void strip_editor_data (node& n, bool in_text)
+{
+  std::vector<node> keep;
+  for (auto& c : n.children)
+  {
+    if (c.is_text ())
+    {
+      // Whitespace is only significant inside text elements.
+      bool blank = true;
+      for (char ch : c.text)
+	blank &= std::isspace ((unsigned char)ch) != 0;
+      if (blank && !in_text)
+	continue;
+    }
+    else if (c.name == "metadata" || is_editor_name (c.name))
+      continue;
+    else
+      strip_editor_data (c, in_text || c.name == "text");
+
+    keep.push_back (std::move (c));
+  }
+  n.children = std::move (keep);
+
+  std::vector<std::pair<std::string, std::string>> attrs;
+  for (auto& a : n.attrs)
+  {
+    if (is_editor_name (a.first))
+      continue;
+    if (has_prefix (a.first, "xmlns:") && a.first != "xmlns:xlink")
+      continue;
+    attrs.push_back (std::move (a));
+  }
+  n.attrs = std::move (attrs);
+}
+
+static void collect_id_refs (const node& n, std::set<std::string>& refs)
+{
+  for (const auto& a : n.attrs)
+  {
+    const std::string& v = a.second;
+    for (size_t p = v.find ("url(#"); p != std::string::npos;
+	 p = v.find ("url(#", p + 1))
+    {
+      size_t end = v.find (')', p);
+      refs.insert (v.substr (p + 5, end - p - 5));
+    }
+    if ((a.first == "xlink:href" || a.first == "href") && has_prefix (v, "#"))
+      refs.insert (v.substr (1));
+  }
+  for (const auto& c : n.children)
+    collect_id_refs (c, refs);
+}
+
+static void rename_ids (node& n, const std::map<std::string, std::string>& ids)
+{
+  for (auto& a : n.attrs)
+  {
+    if (a.first == "id")
+    {
+      auto i = ids.find (a.second);
+      if (i != ids.end ())
+	a.second = i->second;
+      continue;
+    }
+
+    for (const auto& i : ids)
+    {
+      const std::string from = "#" + i.first + ")";
+      for (size_t p = a.second.find (from); p != std::string::npos;
+	   p = a.second.find (from, p + 1))
+	a.second.replace (p + 1, i.first.size (), i.second);
+
+      if ((a.first == "xlink:href" || a.first == "href")
+	  && a.second == "#" + i.first)
+	a.second = "#" + i.second;
+    }
+  }
+  for (auto& c : n.children)
+    rename_ids (c, ids);
+}
+
+static void remove_unused_ids (node& n, const std::map<std::string, std::string>& ids)
+{
+  if (const std::string* id = n.attr ("id"))
+    if (ids.find (*id) == ids.end ())
+      n.erase_attr ("id");
+
+  for (auto& c : n.children)
+    remove_unused_ids (c, ids);
+}
+
+static void shorten_attributes (node& n)
+{
+  for (auto& a : n.attrs)
+  {
+    if (a.first == "style")
+      a.second = clean_style (a.second);
+    else if (a.first == "transform")
+      // Transformation matrices need more precision than coordinates.
+      a.second = shorten_numbers (a.second, decimals + 3);
+    else if (a.first == "d" || a.first == "x" || a.first == "y"
+	     || a.first == "points" || a.first == "stroke-width")
+      a.second = shorten_numbers (a.second, decimals);
+  }
+  for (auto& c : n.children)
+    shorten_attributes (c);
+}
+
+static void dissolve_groups (node& n)
+{
+  std::vector<node> children;
+  for (auto& c : n.children)
+  {
+    dissolve_groups (c);
+    if (c.name == "g" && c.attrs.empty ())
+      for (auto& gc : c.children)
+	children.push_back (std::move (gc));
+    else
+      children.push_back (std::move (c));
+  }
+  n.children = std::move (children);
+}
+
+// Makes the first moveto of a path absolute, so that the path data can be
+// appended to another path.
+static std::string absolute_path_start (const std::string& d)
+{
+  size_t pos = 0;
+  skip_spaces (d, pos);
+  if (pos >= d.size () || d[pos] != 'm')
+    return d;
+  pos++;
+
+  // The first coordinate pair of a relative moveto is absolute.
+  char* end;
+  std::strtod (d.c_str () + pos, &end);
+  while (*end == ',' || std::isspace ((unsigned char)*end))
+    end++;
+  std::strtod (end, &end);
+
+  std::string r = "M" + d.substr (pos, end - d.c_str () - pos);
+
+  // Implicit lineto commands after a moveto are relative if the moveto is.
+  size_t rest = end - d.c_str ();
+  skip_spaces (d, rest);
+  if (rest < d.size () && !std::isalpha ((unsigned char)d[rest]))
+    r += " l";
+  r += ' ';
+  r += d.substr (rest);
+  return r;
+}
+
+static bool is_mergeable_path (node& n)
+{
+  const std::string* style = n.attr ("style");
+  return n.name == "path" && n.children.empty () && n.attr ("id") == nullptr
+	 && n.attr ("d") != nullptr && style != nullptr
+	 && style->find ("fill:none") != std::string::npos
+	 && style->find ("opacity:.") == std::string::npos;
+}
+
+static bool same_attributes_except_d (const node& a, const node& b)
+{
+  auto strip_d = [] (const node& n)
+  {
+    std::vector<std::pair<std::string, std::string>> r;
+    for (const auto& at : n.attrs)
+      if (at.first != "d")
+	r.push_back (at);
+    return r;
+  };
+  return strip_d (a) == strip_d (b);
+}
+
+static void merge_paths (node& n)
+{
+  std::vector<node> children;
+  for (auto& c : n.children)
+  {
+    merge_paths (c);
+    if (!children.empty () && is_mergeable_path (c)
+	&& is_mergeable_path (children.back ())
+	&& same_attributes_except_d (children.back (), c))
+    {
+      std::string& d = *children.back ().attr ("d");
+      d += ' ';
+      d += absolute_path_start (*c.attr ("d"));
+    }
+    else
+      children.push_back (std::move (c));
+  }
+  n.children = std::move (children);
+}
+
+// ----------------------------------------------------------------------------
+
+static void write (std::ostream& out, const node& n)
+{
+  if (n.is_text ())
+  {
+    out << n.text;
+    return;
+  }
+
+  out << '<' << n.name;
+  for (const auto& a : n.attrs)
+    out << ' ' << a.first << "=\"" << a.second << '"';
+
+  if (n.children.empty ())
+  {
+    out << "/>";
+    return;
+  }
+
+  out << '>';
+  for (const auto& c : n.children)
+    write (out, c);
+  out << "</" << n.name << '>';
+}
+
+int main (int argc, char* argv[])
+{
+  std::string id_prefix = "c";
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::strcmp (argv[i], "-p") == 0 && i + 1 < argc)
+      decimals = std::atoi (argv[++i]);
+    else if (std::strcmp (argv[i], "-n") == 0 && i + 1 < argc)
+      id_prefix = argv[++i];
+    else
+    {
+      std::cerr << "usage: " << argv[0]
+		<< " [-p decimals] [-n id_prefix] < in.svg > out.svg"
+		<< std::endl;
+      return 1;
+    }
+  }
+
+  const std::string in ((std::istreambuf_iterator<char> (std::cin)),
+			std::istreambuf_iterator<char> ());
+
+  node doc;
+  size_t pos = 0;
+  parse_children (in, pos, doc);
+
+  node* root = nullptr;
+  for (auto& c : doc.children)
+    if (c.name == "svg")
+      root = &c;
+
+  if (root == nullptr)
+  {
+    std::cerr << "no <svg> element found" << std::endl;
+    return 1;
+  }
+
+  strip_editor_data (*root, false);
+
+  std::set<std::string> refs;
+  collect_id_refs (*root, refs);
+
+  std::map<std::string, std::string> ids;
+  for (const auto& r : refs)
+    ids[r] = id_prefix + std::to_string (ids.size ());
+
+  remove_unused_ids (*root, ids);
+  rename_ids (*root, ids);
+  root->erase_attr ("id");
+  root->erase_attr ("version");
+
+  // A viewBox is required to scale the diagram when it is inlined.
+  const std::string* w = root->attr ("width");
+  const std::string* h = root->attr ("height");
+  if (root->attr ("viewBox") == nullptr && w != nullptr && h != nullptr)
+    root->attrs.emplace_back ("viewBox", "0 0 " + *w + " " + *h);
+
+  shorten_attributes (*root);
+  dissolve_groups (*root);
+  merge_paths (*root);
+
+  write (std::cout, *root);
+  std::cout << std::endl;
+  return 0;
+}